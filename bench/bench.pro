@@ -0,0 +1,50 @@
+QT += core network
+QT -= gui
+
+CONFIG += c++17 console
+
+TEMPLATE = app
+
+TARGET = bench
+
+OBJECTS_DIR = $$PWD/obj
+MOC_DIR = $$PWD/moc
+RCC_DIR = $$PWD/rcc
+
+INCLUDEPATH += $$PWD/../server
+
+# Сервер собирается целиком, кроме main.cpp
+SOURCES += main.cpp \
+           fakesocket.cpp \
+           serverbenchmark.cpp \
+           ../server/server.cpp \
+           ../server/timingwheel.cpp \
+           ../server/messagestore.cpp \
+           ../server/searchindex.cpp \
+           ../server/tracewriter.cpp \
+           ../server/blobstore.cpp \
+           ../server/datachannel.cpp \
+           ../server/messagepipeline.cpp \
+           ../server/messagefilters.cpp \
+           ../server/tlslistener.cpp \
+           ../server/accountstore.cpp \
+           ../server/sequencejournal.cpp
+
+HEADERS += fakesocket.h \
+           serverbenchmark.h \
+           ../server/server.h \
+           ../server/timingwheel.h \
+           ../server/messagestore.h \
+           ../server/searchindex.h \
+           ../server/traceformat.h \
+           ../server/tracewriter.h \
+           ../server/blobstore.h \
+           ../server/datachannel.h \
+           ../server/messagepipeline.h \
+           ../server/messagefilters.h \
+           ../server/tlslistener.h \
+           ../server/accountstore.h \
+           ../server/sequencejournal.h \
+           ../server/latencytrace.h
+
+DESTDIR = $$PWD/../bin
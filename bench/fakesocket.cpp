@@ -0,0 +1,25 @@
+#include "fakesocket.h"
+
+FakeSocket::FakeSocket(QObject *parent) : QTcpSocket(parent)
+{
+    QIODevice::open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+}
+
+qint64 FakeSocket::writtenBytes() const
+{
+    return totalWritten;
+}
+
+qint64 FakeSocket::readData(char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return 0;
+}
+
+qint64 FakeSocket::writeData(const char *data, qint64 size)
+{
+    Q_UNUSED(data);
+    totalWritten += size;
+    return size;
+}
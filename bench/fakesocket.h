@@ -0,0 +1,25 @@
+#ifndef FAKESOCKET_H
+#define FAKESOCKET_H
+
+#include <QTcpSocket>
+
+// Сокет без сети: открыт на запись, всё записанное только подсчитывается.
+// Позволяет гонять код Server без соединений и системных вызовов.
+class FakeSocket : public QTcpSocket
+{
+    Q_OBJECT
+
+public:
+    explicit FakeSocket(QObject *parent = nullptr);
+
+    qint64 writtenBytes() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 size) override;
+
+private:
+    qint64 totalWritten = 0;
+};
+
+#endif // FAKESOCKET_H
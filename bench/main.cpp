@@ -0,0 +1,127 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include "serverbenchmark.h"
+
+static QVector<int> parseList(const QString &value)
+{
+    QVector<int> list;
+    for (const QString &item : value.split(',', Qt::SkipEmptyParts)) {
+        list << item.toInt();
+    }
+    return list;
+}
+
+static QString resultKey(const QJsonObject &result)
+{
+    return QString("%1/%2/%3").arg(result["name"].toString())
+                              .arg(result["users"].toInt())
+                              .arg(result["size"].toInt());
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Server microbenchmarks on in-memory sockets.");
+    parser.addHelpOption();
+    QCommandLineOption usersOption("users", "Comma-separated user counts.", "list", "10,100,1000,10000");
+    QCommandLineOption sizesOption("sizes", "Comma-separated message sizes in bytes.", "list", "16,256,4096");
+    QCommandLineOption timeOption("min-time", "Minimum measuring time per case in ms.", "ms", "200");
+    QCommandLineOption labelOption("label", "Label stored in the report, e.g. a commit hash.", "label");
+    QCommandLineOption jsonOption("json", "Write results as JSON to a file.", "file");
+    QCommandLineOption compareOption("compare", "JSON results of a previous run to compare against.", "file");
+    parser.addOptions({ usersOption, sizesOption, timeOption, labelOption, jsonOption, compareOption });
+    parser.process(a);
+
+    QHash<QString, double> baseline;
+    if (parser.isSet(compareOption)) {
+        QFile file(parser.value(compareOption));
+        if (!file.open(QIODevice::ReadOnly)) {
+            qCritical() << "Cannot open baseline" << file.fileName();
+            return 1;
+        }
+        const QJsonArray previous = QJsonDocument::fromJson(file.readAll()).object()["results"].toArray();
+        for (const QJsonValue &value : previous) {
+            baseline.insert(resultKey(value.toObject()), value.toObject()["ns_per_op"].toDouble());
+        }
+    }
+
+    QString jsonPath = QFileInfo(parser.value(jsonOption)).absoluteFilePath();
+
+    // Сервер пишет журнал сообщений в текущий каталог, поэтому работаем во временном
+    QTemporaryDir workDir;
+    if (!workDir.isValid() || !QDir::setCurrent(workDir.path())) {
+        qCritical() << "Cannot create a temporary directory";
+        return 1;
+    }
+
+    // Вывод logAction в консоль исказил бы замеры
+    qInstallMessageHandler([](QtMsgType, const QMessageLogContext &, const QString &) {});
+
+    qint64 minDuration = parser.value(timeOption).toLongLong() * 1000000;
+    QVector<int> sizes = parseList(parser.value(sizesOption));
+    QJsonArray results;
+    QTextStream out(stdout);
+
+    for (int users : parseList(parser.value(usersOption))) {
+        if (users <= 0) continue;
+
+        ServerBenchmark benchmark(users, minDuration);
+        if (!benchmark.deliversSynchronously()) {
+            // route_direct измерил бы только постановку в очередь конвейера
+            qInstallMessageHandler(nullptr);
+            qCritical() << "The message pipeline has filters, route_direct would not measure delivery";
+            return 1;
+        }
+        QVector<BenchResult> caseResults;
+        for (int size : sizes) caseResults += benchmark.run(size);
+        for (int size : sizes) caseResults += benchmark.runWithHistory(size);
+
+        for (const BenchResult &result : qAsConst(caseResults)) {
+            QJsonObject json;
+            json["name"] = result.name;
+            json["users"] = result.users;
+            json["size"] = result.messageSize;
+            json["iterations"] = double(result.iterations);
+            json["ns_per_op"] = result.nsPerOp;
+            json["ops_per_sec"] = result.nsPerOp > 0 ? 1e9 / result.nsPerOp : 0.0;
+            json["bytes_per_op"] = result.bytesPerOp;
+            results.append(json);
+
+            out << resultKey(json).leftJustified(40) << QString::number(result.nsPerOp, 'f', 1).rightJustified(14) << " ns/op";
+            double base = baseline.value(resultKey(json));
+            if (base > 0) {
+                out << QString("  (baseline %1, %2%)").arg(base, 0, 'f', 1)
+                                                      .arg((result.nsPerOp - base) / base * 100.0, 0, 'f', 1);
+            }
+            out << "\n";
+            out.flush();
+        }
+    }
+
+    if (parser.isSet(jsonOption)) {
+        QJsonObject report;
+        report["label"] = parser.value(labelOption);
+        report["synchronous_delivery"] = true; // Иначе прогон остановлен выше
+        report["results"] = results;
+
+        QFile file(jsonPath);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qInstallMessageHandler(nullptr);
+            qCritical() << "Cannot write results" << file.fileName();
+            return 1;
+        }
+        file.write(QJsonDocument(report).toJson());
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include "serverbenchmark.h"
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+
+ServerBenchmark::ServerBenchmark(int users, qint64 minDuration)
+    : minDuration(minDuration)
+{
+    for (int i = 0; i < users; ++i) {
+        FakeSocket *socket = new FakeSocket(&server);
+        QString username = QString("user%1").arg(i);
+        ServerBenchHook::addSession(server, socket, username);
+        sockets.append(socket);
+    }
+}
+
+bool ServerBenchmark::deliversSynchronously() const
+{
+    return ServerBenchHook::deliversSynchronously(server);
+}
+
+QVector<BenchResult> ServerBenchmark::run(int messageSize)
+{
+    QVector<BenchResult> results;
+    QTcpSocket *sender = sockets.first();
+    QString text = payload(messageSize);
+
+    // PONG ничего не делает, поэтому остаётся чистая стоимость разбора строки
+    QString parseOnly = "PONG " + text;
+    results << measure("parse", messageSize, [&](qint64) {
+        ServerBenchHook::processLine(server, sender, parseOnly);
+    });
+
+    QStringList direct = directMessages(messageSize);
+    results << measure("route_direct", messageSize, [&](qint64 i) {
+        ServerBenchHook::processLine(server, sender, direct[int(i % direct.size())]);
+    });
+
+    results << measure("user_list", messageSize, [&](qint64) {
+        QString list = ServerBenchHook::userList(server);
+        Q_UNUSED(list);
+    });
+
+    results << measure("broadcast", messageSize, [&](qint64) {
+        ServerBenchHook::broadcast(server, "user0", text);
+    });
+
+    return results;
+}
+
+QVector<BenchResult> ServerBenchmark::runWithHistory(int messageSize)
+{
+    if (!historyOpen) {
+        ServerBenchHook::openMessageHistory(server); // Каталог messages в текущей (временной) директории
+        historyOpen = true;
+    }
+
+    QVector<BenchResult> results;
+    QTcpSocket *sender = sockets.first();
+
+    QStringList direct = directMessages(messageSize);
+    results << measure("route_direct_persisted", messageSize, [&](qint64 i) {
+        ServerBenchHook::processLine(server, sender, direct[int(i % direct.size())]);
+    });
+
+    QString search = "SEARCH lorem ipsum 20";
+    results << measure("search", messageSize, [&](qint64) {
+        ServerBenchHook::processLine(server, sender, search);
+    });
+
+    return results;
+}
+
+template<typename Op>
+BenchResult ServerBenchmark::measure(const QString &name, int messageSize, Op op)
+{
+    for (qint64 i = 0; i < 3; ++i) op(i); // Прогрев
+
+    qint64 writtenBefore = totalWritten();
+    qint64 iterations = 0;
+    qint64 batch = 1;
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.nsecsElapsed() < minDuration) {
+        for (qint64 i = 0; i < batch; ++i) op(iterations++);
+        batch = qMin<qint64>(batch * 2, 4096);
+    }
+    qint64 elapsed = timer.nsecsElapsed();
+
+    BenchResult result;
+    result.name = name;
+    result.users = sockets.size();
+    result.messageSize = messageSize;
+    result.iterations = iterations;
+    result.nsPerOp = double(elapsed) / iterations;
+    result.bytesPerOp = double(totalWritten() - writtenBefore) / iterations;
+    return result;
+}
+
+QStringList ServerBenchmark::directMessages(int messageSize) const
+{
+    // Заранее готовые команды со случайными получателями, чтобы не форматировать строки в замере
+    QStringList messages;
+    QString text = payload(messageSize);
+    QRandomGenerator random(42);
+    for (int i = 0; i < 64; ++i) {
+        int recipient = int(random.bounded(quint32(sockets.size())));
+        messages << QString("MSG user%1 %2").arg(recipient).arg(text);
+    }
+    return messages;
+}
+
+qint64 ServerBenchmark::totalWritten() const
+{
+    qint64 total = 0;
+    for (FakeSocket *socket : sockets) {
+        total += socket->writtenBytes();
+    }
+    return total;
+}
+
+QString ServerBenchmark::payload(int size)
+{
+    static const QStringList words = { "lorem", "ipsum", "dolor", "sit", "amet", "consectetur",
+                                       "adipiscing", "elit", "sed", "do", "eiusmod", "tempor" };
+    QString text;
+    text.reserve(size + 16);
+    for (int i = 0; text.size() < size; ++i) {
+        if (!text.isEmpty()) text += ' ';
+        text += words[i % words.size()];
+    }
+    text.truncate(size);
+    return text;
+}
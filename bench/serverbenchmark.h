@@ -0,0 +1,47 @@
+#ifndef SERVERBENCHMARK_H
+#define SERVERBENCHMARK_H
+
+#include <QVector>
+#include <QStringList>
+#include "server.h"
+#include "fakesocket.h"
+
+struct BenchResult
+{
+    QString name;
+    int users = 0;
+    int messageSize = 0;
+    qint64 iterations = 0;
+    double nsPerOp = 0;
+    double bytesPerOp = 0; // Сколько байт сервер записал в сокеты за операцию
+};
+
+// Горячие пути Server на подставных сокетах: разбор команды, поиск
+// получателя, формирование списка пользователей и рассылка всем.
+// Все пользователи считаются вошедшими, user0 выступает отправителем.
+// Server доступен только через ServerBenchHook.
+class ServerBenchmark
+{
+public:
+    ServerBenchmark(int users, qint64 minDuration);
+
+    bool deliversSynchronously() const; // Конвейер без фильтров: route_* измеряют доставку, а не очередь
+
+    QVector<BenchResult> run(int messageSize);
+    QVector<BenchResult> runWithHistory(int messageSize); // С журналом и индексом сообщений
+
+private:
+    Server server;
+    QVector<FakeSocket*> sockets;
+    qint64 minDuration; // нс на один замер
+    bool historyOpen = false;
+
+    template<typename Op>
+    BenchResult measure(const QString &name, int messageSize, Op op);
+
+    QStringList directMessages(int messageSize) const;
+    qint64 totalWritten() const;
+    static QString payload(int size);
+};
+
+#endif // SERVERBENCHMARK_H
@@ -1,16 +1,30 @@
 #include "chatwindow.h"
 #include "ui_chatwindow.h"
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QStandardPaths>
 
-ChatWindow::ChatWindow(const QString &recipient, QTcpSocket *socket, QWidget *parent) :
+ChatWindow::ChatWindow(const QString &recipient, const QString &username, const QString &cacheDirectory,
+                       ClientConnection *connection, QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::ChatWindow),
     recipient(recipient),
-    socket(socket)
+    username(username),
+    connection(connection),
+    transcript(new TranscriptModel(this))
 {
     ui->setupUi(this);
 
+    // Кеш открывается без чтения истории, вид сразу показывает последние строки
+    if (!cacheDirectory.isEmpty()) transcript->open(cacheDirectory, recipient);
+    ui->transcriptView->setModel(transcript);
+
+    syncTimeout.setSingleShot(true);
+    syncTimeout.setInterval(10000);
+    connect(&syncTimeout, &QTimer::timeout, this, &ChatWindow::finishSync);
     connect(ui->sendMessageButton, &QPushButton::clicked, this, &ChatWindow::onSendMessageButtonClicked);
-    connect(socket, &QTcpSocket::readyRead, this, &ChatWindow::onReadyRead);
+    connect(ui->attachButton, &QPushButton::clicked, this, &ChatWindow::onAttachButtonClicked);
+    connect(ui->transcriptView, &TranscriptView::rowDoubleClicked, this, &ChatWindow::onRowDoubleClicked);
 
     setWindowTitle("Chat with " + recipient);
 }
@@ -20,28 +34,131 @@ ChatWindow::~ChatWindow()
     delete ui;
 }
 
+void ChatWindow::startSync()
+{
+    if (syncing) return;
+
+    syncing = true;
+    syncCursor = transcript->lastId();
+    connection->requestHistory(recipient, syncCursor, historyPageSize);
+    syncTimeout.start(); // Если ответа не будет, живые сообщения не должны копиться вечно
+}
+
+void ChatWindow::receive(const QVector<ChatLine> &messages)
+{
+    QStringList lines;
+    QVector<quint64> ids;
+    QVector<ChatLine> live;
+
+    for (const ChatLine &message : messages) {
+        switch (message.kind) {
+        case ChatLine::Live:
+            if (syncing) {
+                deferred.append(message);
+            } else {
+                live.append(message);
+            }
+            break;
+        case ChatLine::Sent:
+            lines << "Me: " + message.text;
+            ids << 0;
+            break;
+        case ChatLine::Delivered:
+            // Строка "Me" могла быть ещё не записана, ищем её уже в кеше
+            transcript->appendLines(lines, ids);
+            lines.clear();
+            ids.clear();
+            if (!transcript->assignId("Me: " + message.text, message.id)) {
+                lines << "Me: " + message.text;
+                ids << message.id;
+            }
+            deliveredIds.insert(message.id);
+            break;
+        case ChatLine::History:
+            if (!syncing || message.id <= syncCursor) break;
+            syncCursor = message.id;
+            // Отправленное отсюда уже показано; с других устройств — нет
+            if (deliveredIds.contains(message.id)) break;
+            lines << (message.sender == username ? QString("Me") : message.sender) + ": " + message.text;
+            ids << message.id;
+            break;
+        case ChatLine::HistoryEnd:
+            if (!syncing) break;
+            if (message.text.toInt() >= historyPageSize) {
+                connection->requestHistory(recipient, syncCursor, historyPageSize);
+                syncTimeout.start();
+            } else {
+                transcript->appendLines(lines, ids);
+                lines.clear();
+                ids.clear();
+                finishSync();
+            }
+            break;
+        }
+    }
+
+    transcript->appendLines(lines, ids);
+    appendLive(live);
+}
+
+void ChatWindow::finishSync()
+{
+    if (!syncing) return;
+
+    syncing = false;
+    syncTimeout.stop();
+
+    QVector<ChatLine> pendingLive;
+    pendingLive.swap(deferred);
+    appendLive(pendingLive);
+}
+
+void ChatWindow::appendLive(const QVector<ChatLine> &messages)
+{
+    QStringList lines;
+    QVector<quint64> ids;
+    quint64 lastId = transcript->lastId();
+    for (const ChatLine &message : messages) {
+        if (message.id != 0 && message.id <= lastId) continue; // Уже пришло с историей
+        lines << message.sender + ": " + message.text;
+        ids << message.id;
+    }
+    transcript->appendLines(lines, ids); // Одна вставка и одна перерисовка на всю пачку
+}
+
 void ChatWindow::onSendMessageButtonClicked()
 {
     QString message = ui->messageLineEdit->text().trimmed();
     if (!message.isEmpty()) {
         sendMessage(message);
-        ui->chatTextEdit->append("Me: " + message);
+        transcript->appendLines(QStringList() << "Me: " + message);
         ui->messageLineEdit->clear();
     }
 }
 
-void ChatWindow::onReadyRead()
+void ChatWindow::onAttachButtonClicked()
 {
-    QString response = QString::fromUtf8(socket->readAll()).trimmed();
-    QStringList messages = response.split("\n");
-    for (const QString &message : messages) {
-        ui->chatTextEdit->append(message);
+    QString path = QFileDialog::getOpenFileName(this, "Attach file");
+    if (!path.isEmpty()) {
+        connection->sendFile(recipient, path); // Ссылка появится в переписке, когда файл загрузится
     }
 }
 
-void ChatWindow::sendMessage(const QString &message)
+void ChatWindow::onRowDoubleClicked(int row)
 {
-    if (socket->state() == QTcpSocket::ConnectedState) {
-        socket->write(("MSG " + recipient + " " + message + "\n").toUtf8());
+    // Строка кеша — "<отправитель>: <текст>"
+    Attachment attachment;
+    if (!Attachment::parse(transcript->text(row).section(": ", 1), attachment)) return;
+
+    QString directory = QStandardPaths::writableLocation(QStandardPaths::DownloadLocation);
+    QString path = QFileDialog::getSaveFileName(this, "Save file",
+                                                directory + "/" + QFileInfo(attachment.name).fileName());
+    if (!path.isEmpty()) {
+        connection->downloadFile(attachment, path);
     }
 }
+
+void ChatWindow::sendMessage(const QString &message)
+{
+    connection->sendChatMessage(recipient, message);
+}
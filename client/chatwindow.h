@@ -2,7 +2,10 @@
 #define CHATWINDOW_H
 
 #include <QMainWindow>
-#include <QTcpSocket>
+#include <QTimer>
+#include <QSet>
+#include "clientconnection.h"
+#include "transcriptmodel.h"
 
 namespace Ui {
 class ChatWindow;
@@ -13,19 +16,36 @@ class ChatWindow : public QMainWindow
     Q_OBJECT
 
 public:
-    explicit ChatWindow(const QString &recipient, QTcpSocket *socket, QWidget *parent = nullptr);
+    explicit ChatWindow(const QString &recipient, const QString &username, const QString &cacheDirectory,
+                        ClientConnection *connection, QWidget *parent = nullptr);
     ~ChatWindow();
 
+    void startSync(); // Догрузить с сервера то, чего нет в локальном кеше
+    void receive(const QVector<ChatLine> &messages);
+
 private slots:
     void onSendMessageButtonClicked();
-    void onReadyRead();
+    void onAttachButtonClicked();
+    void onRowDoubleClicked(int row);
+    void finishSync();
 
 private:
+    static constexpr int historyPageSize = 200;
+
     Ui::ChatWindow *ui;
     QString recipient;
-    QTcpSocket *socket;
+    QString username;
+    ClientConnection *connection;
+    TranscriptModel *transcript;
+
+    bool syncing = false;
+    quint64 syncCursor = 0; // Наибольший id, полученный в текущей догрузке
+    QVector<ChatLine> deferred; // Живые сообщения, пришедшие во время догрузки
+    QSet<quint64> deliveredIds; // id своих сообщений, подтверждённых в этом запуске
+    QTimer syncTimeout;
 
     void sendMessage(const QString &message);
+    void appendLive(const QVector<ChatLine> &messages);
 };
 
 #endif // CHATWINDOW_H
@@ -1,6 +1,8 @@
 QT += core gui widgets network
 CONFIG += c++17
 
+INCLUDEPATH += $$PWD/../server
+
 TEMPLATE = app
 
 TARGET = client
@@ -15,13 +17,28 @@ SOURCES += \
     mainwindow.cpp \
     registerdialog.cpp \
     logindialog.cpp \
-    chatwindow.cpp
+    chatwindow.cpp \
+    clientconnection.cpp \
+    transcriptmodel.cpp \
+    transcriptview.cpp \
+    rostermodel.cpp \
+    conversationcache.cpp \
+    outbox.cpp \
+    filetransfer.cpp
 
 HEADERS += \
     mainwindow.h \
     registerdialog.h \
     logindialog.h \
-    chatwindow.h
+    chatwindow.h \
+    clientconnection.h \
+    transcriptmodel.h \
+    transcriptview.h \
+    rostermodel.h \
+    conversationcache.h \
+    outbox.h \
+    filetransfer.h \
+    ../server/latencytrace.h
 
 FORMS += \
     mainwindow.ui \
@@ -0,0 +1,458 @@
+#include "clientconnection.h"
+#include "latencytrace.h"
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QSignalBlocker>
+#include <QStandardPaths>
+
+ClientConnection::ClientConnection(QObject *parent)
+    : QObject(parent)
+    , socket(new QSslSocket(this))
+    , flushTimer(new QTimer(this))
+    , reconnectTimer(new QTimer(this))
+    , retryTimer(new QTimer(this))
+{
+    qRegisterMetaType<ClientBatch>();
+
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(frameInterval);
+    connect(flushTimer, &QTimer::timeout, this, &ClientConnection::flushBatch);
+
+    reconnectTimer->setSingleShot(true);
+    connect(reconnectTimer, &QTimer::timeout, this, &ClientConnection::reconnect);
+
+    retryTimer->setSingleShot(true);
+    connect(retryTimer, &QTimer::timeout, this, &ClientConnection::sendNextRetry);
+
+    connect(socket, &QTcpSocket::readyRead, this, &ClientConnection::onReadyRead);
+    connect(socket, &QSslSocket::connected, this, &ClientConnection::onConnected);
+    connect(socket, &QSslSocket::encrypted, this, &ClientConnection::onEncrypted);
+    connect(socket, qOverload<const QList<QSslError> &>(&QSslSocket::sslErrors), this, &ClientConnection::onSslErrors);
+    connect(socket, &QTcpSocket::stateChanged, this, &ClientConnection::onStateChanged);
+
+    // Клиент сохраняет билет сессии, чтобы переподключение к серверу, который
+    // их принимает, обходилось без полного рукопожатия
+    sslConfiguration = QSslConfiguration::defaultConfiguration();
+    sslConfiguration.setProtocol(QSsl::TlsV1_2OrLater);
+    sslConfiguration.setSslOption(QSsl::SslOptionDisableSessionTickets, false);
+    sslConfiguration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+}
+
+void ClientConnection::connectToServer(const QStringList &endpoints)
+{
+    QMetaObject::invokeMethod(this, [this, endpoints]() {
+        this->endpoints = endpoints;
+        endpointIndex = 0;
+        attempt = 0;
+        stopped = endpoints.isEmpty();
+        reconnect();
+    });
+}
+
+void ClientConnection::setCaCertificates(const QList<QSslCertificate> &certificates)
+{
+    QMetaObject::invokeMethod(this, [this, certificates]() {
+        QList<QSslCertificate> all = QSslConfiguration::systemCaCertificates();
+        all += certificates;
+        sslConfiguration.setCaCertificates(all);
+    });
+}
+
+void ClientConnection::login(const QString &username, const QString &password)
+{
+    QMetaObject::invokeMethod(this, [this, username, password]() {
+        this->username = username;
+        this->password = password;
+        resumeToken.clear();
+
+        // Очередь своя у каждого пользователя, в ней могут ждать сообщения с прошлого запуска
+        QString directory = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+        outbox.open(directory + "/outbox/" + QString::fromLatin1(username.toUtf8().toHex()) + ".log");
+
+        if (isReady()) startSession();
+    });
+}
+
+void ClientConnection::sendCommand(const QString &command)
+{
+    // Из GUI-потока вызов уходит в очередь потока соединения, из своего выполняется сразу
+    QMetaObject::invokeMethod(this, [this, command]() {
+        writeCommand(command);
+    });
+}
+
+void ClientConnection::sendChatMessage(const QString &recipient, const QString &text)
+{
+    // Трасса начинается в потоке GUI, чтобы учесть и переход в поток соединения
+    quint64 traceId = LatencyTrace::sample();
+    qint64 startNs = traceId ? LatencyTrace::now() : 0;
+    QMetaObject::invokeMethod(this, [this, recipient, text, traceId, startNs]() {
+        QString prefix = traceId ? QString::fromLatin1(LatencyTrace::framePrefix(traceId)) : QString();
+        if (!outbox.isOpen()) {
+            writeCommand(prefix + "MSG " + recipient + " " + text); // Вход ещё не выполнялся, подтверждать нечего
+            if (traceId) LatencyTrace::record("client.send", traceId, startNs, LatencyTrace::now());
+            return;
+        }
+
+        // Сначала на диск, потом в сеть: без ACK сообщение уйдёт снова после переподключения
+        OutgoingMessage message = outbox.enqueue(recipient, text);
+        // Пока есть отложенные по RETRY, новое ждёт за ними: иначе обгонит меньший номер и тот получит DUP
+        if (sessionStarted && !outbox.hasDeferred()) {
+            writeCommand(prefix + QString("SEND %1 %2 %3").arg(message.sequence).arg(message.recipient, message.text));
+        }
+        if (traceId) {
+            qint64 sentNs = LatencyTrace::now();
+            LatencyTrace::record("client.send", traceId, startNs, sentNs);
+            tracedSends.insert(message.sequence, TracedSend{traceId, sentNs});
+        }
+    });
+}
+
+void ClientConnection::requestHistory(const QString &conversation, quint64 afterId, int limit)
+{
+    QString scope = conversation == "ALL" ? QString("#ALL") : "@" + conversation;
+    sendCommand(QString("HISTORY %1 %2 %3").arg(scope).arg(afterId).arg(limit));
+}
+
+void ClientConnection::sendFile(const QString &recipient, const QString &path)
+{
+    QMetaObject::invokeMethod(this, [this, recipient, path]() {
+        Attachment attachment;
+        attachment.name = QFileInfo(path).fileName().simplified(); // Имя уходит в строку протокола
+        startTransfer(createTransfer(FileTransfer::Upload, path, recipient, attachment));
+    });
+}
+
+void ClientConnection::downloadFile(const Attachment &attachment, const QString &path)
+{
+    QMetaObject::invokeMethod(this, [this, attachment, path]() {
+        startTransfer(createTransfer(FileTransfer::Download, path, QString(), attachment));
+    });
+}
+
+FileTransfer *ClientConnection::createTransfer(FileTransfer::Direction direction, const QString &path,
+                                               const QString &recipient, const Attachment &attachment)
+{
+    // Подключаем один раз: повторы после обрыва снова проходят через startTransfer
+    auto *transfer = new FileTransfer(direction, path, recipient, attachment, this);
+    connect(transfer, &FileTransfer::finished, this, [this, transfer](bool ok, const QString &error) {
+        onTransferFinished(transfer, ok, error);
+    });
+    return transfer;
+}
+
+void ClientConnection::startTransfer(FileTransfer *transfer)
+{
+    if (dataToken.isEmpty()) {
+        queuedTransfers.append(transfer);
+        if (sessionStarted && !awaitingLogin) writeCommand("DATA");
+        return;
+    }
+    transfer->start(dataHost, dataPort, dataToken);
+}
+
+void ClientConnection::onTransferFinished(FileTransfer *transfer, bool ok, const QString &error)
+{
+    QString name = transfer->attachment().name;
+    if (!ok && transfer->canResume() && transfer->attempts() < maxTransferAttempts) {
+        // Продолжим с того же места; если сессия за это время сменилась, дождёмся нового токена
+        pending.statuses.append(QString("Transfer of %1 interrupted, resuming").arg(name));
+        scheduleFlush();
+        QTimer::singleShot(transferRetryDelay, transfer, [this, transfer]() {
+            startTransfer(transfer);
+        });
+        return;
+    }
+
+    if (!ok) {
+        pending.statuses.append(QString("Transfer of %1 failed: %2").arg(name, error));
+    } else if (transfer->direction() == FileTransfer::Upload) {
+        // Файл на сервере, теперь ссылку на него отправляем обычным сообщением
+        QString text = transfer->attachment().toText();
+        sendChatMessage(transfer->recipient(), text);
+
+        ChatLine line;
+        line.kind = ChatLine::Sent;
+        line.conversation = transfer->recipient();
+        line.text = text;
+        pending.messages.append(line);
+        pending.statuses.append("Sent file " + name);
+    } else {
+        pending.statuses.append("Saved " + transfer->path());
+    }
+    scheduleFlush();
+    transfer->deleteLater();
+}
+
+void ClientConnection::onConnected()
+{
+    if (useTls) return; // Ждём окончания рукопожатия, см. onEncrypted
+    attempt = 0;
+    pending.statuses.append("Connected to " + endpoints.value(endpointIndex));
+    scheduleFlush();
+
+    if (!username.isEmpty()) startSession();
+}
+
+void ClientConnection::onEncrypted()
+{
+    sslConfiguration.setSessionTicket(socket->sslConfiguration().sessionTicket());
+    attempt = 0;
+    pending.statuses.append("Connected securely to " + endpoints.value(endpointIndex));
+    scheduleFlush();
+
+    if (!username.isEmpty()) startSession();
+}
+
+void ClientConnection::onSslErrors(const QList<QSslError> &errors)
+{
+    // Непроверенному серверу пароль не отправляем; переподключение попробует снова
+    pending.statuses.append("TLS error: " + errors.value(0).errorString());
+    scheduleFlush();
+}
+
+void ClientConnection::onStateChanged(QAbstractSocket::SocketState state)
+{
+    if (state != QAbstractSocket::UnconnectedState) return;
+
+    sessionStarted = false;
+    readBuffer.clear();
+    dataToken.clear();
+    if (stopped || reconnectTimer->isActive()) return;
+
+    // Первая попытка сразу: короткий обрыв не должен быть заметен.
+    // Дальше задержка растёт вдвое, половина её случайна, чтобы клиенты
+    // после падения сервера не приходили все одновременно.
+    int delay = 0;
+    if (attempt > 0) {
+        int backoff = int(qMin<qint64>(maxBackoff, qint64(initialBackoff) << qMin(attempt - 1, 16)));
+        delay = backoff / 2 + int(QRandomGenerator::global()->bounded(backoff / 2 + 1));
+        endpointIndex = (endpointIndex + 1) % endpoints.size();
+    }
+    ++attempt;
+
+    pending.statuses.append(QString("Disconnected, reconnecting in %1 ms").arg(delay));
+    scheduleFlush();
+    reconnectTimer->start(delay);
+}
+
+void ClientConnection::reconnect()
+{
+    if (stopped || endpoints.isEmpty()) return;
+
+    QString endpoint = endpoints.value(endpointIndex);
+    useTls = endpoint.startsWith("tls://");
+    if (useTls) endpoint = endpoint.mid(6);
+    int colon = endpoint.lastIndexOf(':');
+    QString host = colon > 0 ? endpoint.left(colon) : endpoint;
+    quint16 port = colon > 0 ? quint16(endpoint.mid(colon + 1).toUInt()) : (useTls ? 1236 : 1234);
+
+    {
+        const QSignalBlocker blocker(socket); // Сброс старого сокета не должен планировать ещё одну попытку
+        socket->abort();
+    }
+    if (useTls) {
+        socket->setSslConfiguration(sslConfiguration);
+        socket->connectToHostEncrypted(host, port);
+    } else {
+        socket->connectToHost(host, port);
+    }
+}
+
+void ClientConnection::startSession()
+{
+    // LOGIN и очередь одной записью: сервер разбирает строки по порядку,
+    // так что SEND обработаются уже после входа
+    // С токеном прошлой сессии сервер не проверяет пароль по файлу пользователей
+    // CLIENT первым: по нему сервер отсеивает повторы SEND этой установки
+    QByteArray batch = outbox.isOpen() ? ("CLIENT " + outbox.clientId() + "\n").toUtf8() : QByteArray();
+    batch += resumeToken.isEmpty() ? ("LOGIN " + username + " " + password + "\n").toUtf8()
+                                   : ("RESUME " + resumeToken + "\n").toUtf8();
+    for (const OutgoingMessage &message : outbox.pending()) {
+        batch += QString("SEND %1 %2 %3\n").arg(message.sequence).arg(message.recipient, message.text).toUtf8();
+    }
+    socket->write(batch);
+    outbox.clearDeferred(); // Отложенные ушли вместе со всей очередью
+    retryTimer->stop();
+
+    sessionStarted = true;
+    awaitingLogin = true;
+}
+
+bool ClientConnection::isReady() const
+{
+    // До конца TLS-рукопожатия писать рано: onEncrypted начнёт сессию сам
+    return socket->state() == QAbstractSocket::ConnectedState && (!useTls || socket->isEncrypted());
+}
+
+void ClientConnection::writeCommand(const QString &command)
+{
+    if (isReady()) {
+        socket->write((command + "\n").toUtf8());
+    }
+}
+
+void ClientConnection::onReadyRead()
+{
+    qint64 readStart = LatencyTrace::isEnabled() ? LatencyTrace::now() : 0;
+    readBuffer.append(socket->readAll());
+    int end = readBuffer.lastIndexOf('\n');
+    if (end < 0) return;
+
+    QByteArray lines = readBuffer.left(end);
+    readBuffer.remove(0, end + 1);
+    qint64 readEnd = readStart ? LatencyTrace::now() : 0;
+
+    for (QByteArray line : lines.split('\n')) {
+        // Сервер помечает трассируемые сообщения, даже если у нас трассировка выключена
+        quint64 traceId = LatencyTrace::takeFramePrefix(line);
+        if (traceId && readStart) LatencyTrace::record("client.read", traceId, readStart, readEnd);
+
+        int parsed = pending.messages.size();
+        processLine(QString::fromUtf8(line).trimmed());
+        if (traceId && readStart && pending.messages.size() > parsed) {
+            pending.messages.last().traceId = traceId;
+            pending.messages.last().receivedNs = readEnd;
+        }
+    }
+}
+
+void ClientConnection::processLine(const QString &line)
+{
+    if (line.isEmpty()) return;
+
+    QString command = line.section(' ', 0, 0);
+    if (command == "FROM" || command == "BCAST") {
+        // FROM|BCAST <id> <отправитель> <текст>
+        ChatLine message;
+        message.id = line.section(' ', 1, 1).toULongLong();
+        message.sender = line.section(' ', 2, 2);
+        message.text = line.section(' ', 3);
+        message.conversation = command == "BCAST" ? QString("ALL") : message.sender;
+        pending.messages.append(message);
+    } else if (command == "HIST") {
+        // HIST <беседа> <id> <отправитель> <текст>
+        ChatLine message;
+        message.kind = ChatLine::History;
+        message.conversation = line.section(' ', 1, 1);
+        message.id = line.section(' ', 2, 2).toULongLong();
+        message.sender = line.section(' ', 3, 3);
+        message.text = line.section(' ', 4);
+        pending.messages.append(message);
+    } else if (command == "HISTEND") {
+        ChatLine message;
+        message.kind = ChatLine::HistoryEnd;
+        message.conversation = line.section(' ', 1, 1);
+        message.text = line.section(' ', 2, 2);
+        pending.messages.append(message);
+    } else if (command == "USERS") {
+        pending.users = line.section(' ', 1).split(' ', Qt::SkipEmptyParts);
+        pending.hasUsers = true;
+        pending.presence.clear(); // Более старые изменения в той же пачке уже учтены в списке
+    } else if (command == "JOIN" || command == "LEAVE") {
+        pending.presence.append(qMakePair(line.section(' ', 1, 1), command == "JOIN"));
+    } else if (command == "PING") {
+        writeCommand("PONG"); // Ответ на проверку соединения сервером
+        return;
+    } else if (command == "DATA") {
+        // DATA <порт> <токен>: файловый канал на том же хосте
+        dataHost = socket->peerName().isEmpty() ? socket->peerAddress().toString() : socket->peerName();
+        dataPort = quint16(line.section(' ', 1, 1).toUInt());
+        dataToken = line.section(' ', 2, 2).toLatin1();
+        QVector<FileTransfer*> transfers;
+        transfers.swap(queuedTransfers);
+        for (FileTransfer *transfer : qAsConst(transfers)) {
+            transfer->start(dataHost, dataPort, dataToken);
+        }
+        return;
+    } else if (command == "SESSION") {
+        resumeToken = line.section(' ', 1, 1);
+        return;
+    } else if (command == "ACK") {
+        // ACK <номер> <id>. ACK с id 0 доставку не подтверждает: сообщение
+        // остаётся в очереди, и если сервер его уже принял, на повтор в
+        // следующей сессии он ответит DUP
+        quint64 sequence = line.section(' ', 1, 1).toULongLong();
+        quint64 id = line.section(' ', 2, 2).toULongLong();
+        if (!tracedSends.isEmpty()) {
+            // Полный круг: запись в сокет, сервер, ACK обратно
+            TracedSend traced = tracedSends.take(sequence);
+            LatencyTrace::record("client.ack", traced.traceId, traced.sentNs, LatencyTrace::now());
+        }
+        OutgoingMessage sent;
+        if (id == 0 || !outbox.remove(sequence, &sent)) return;
+
+        // По id окно узнает это сообщение, когда оно вернётся в ответе на HISTORY
+        ChatLine message;
+        message.kind = ChatLine::Delivered;
+        message.conversation = sent.recipient;
+        message.sender = username;
+        message.text = sent.text;
+        message.id = id;
+        pending.messages.append(message);
+    } else if (command == "RETRY") {
+        // RETRY <номер> <мс>: не принято из-за частоты. Повторяем под новым
+        // номером, по одному сообщению за интервал, чтобы не упереться снова всей пачкой;
+        // набранное тем временем ждёт за ним (Outbox::hasDeferred)
+        quint64 sequence = line.section(' ', 1, 1).toULongLong();
+        tracedSends.remove(sequence);
+        if (outbox.requeue(sequence).sequence == 0) return;
+        retryTimer->setInterval(qBound(100, line.section(' ', 2, 2).toInt(), 60000));
+        if (!retryTimer->isActive()) retryTimer->start();
+        return;
+    } else if (command == "DUP" || command == "REJECTED") {
+        // Принято раньше или отклонено модерацией (причина пришла в ERROR): больше не отправляем
+        quint64 sequence = line.section(' ', 1, 1).toULongLong();
+        outbox.remove(sequence);
+        tracedSends.remove(sequence);
+        return;
+    } else if (command == "OK" || command == "ERROR") {
+        if (line.startsWith("OK Logged in successfully")) {
+            pending.loggedIn = true;
+            pending.username = username;
+            awaitingLogin = false;
+            if (!queuedTransfers.isEmpty()) writeCommand("DATA");
+        } else if (line.startsWith("ERROR Session taken over")) {
+            stopped = true; // Вошли с другого места, иначе клиенты будут выбивать друг друга
+        } else if (line.startsWith("ERROR Invalid session")) {
+            // Токен истёк или сервер перезапускался: входим паролем. Ответы
+            // "Not logged in" на уже отправленные SEND ничего не значат,
+            // очередь уйдёт заново вместе с LOGIN.
+            resumeToken.clear();
+            startSession();
+            return;
+        } else if (awaitingLogin && (line.startsWith("ERROR Invalid password") || line.startsWith("ERROR User does not exist"))) {
+            // Неверные данные входа: не повторяем их при каждом переподключении
+            awaitingLogin = false;
+            sessionStarted = false;
+            username.clear();
+            password.clear();
+        }
+        pending.statuses.append(line);
+    } else {
+        return;
+    }
+    scheduleFlush();
+}
+
+void ClientConnection::sendNextRetry()
+{
+    if (!sessionStarted) return; // Новая сессия отправит всю очередь сама
+
+    OutgoingMessage message = outbox.takeDeferred();
+    if (message.sequence != 0) {
+        writeCommand(QString("SEND %1 %2 %3").arg(message.sequence).arg(message.recipient, message.text));
+    }
+    if (outbox.hasDeferred()) retryTimer->start();
+}
+
+void ClientConnection::scheduleFlush()
+{
+    if (!flushTimer->isActive()) flushTimer->start();
+}
+
+void ClientConnection::flushBatch()
+{
+    emit batchReady(pending);
+    pending = ClientBatch();
+}
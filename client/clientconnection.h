@@ -0,0 +1,139 @@
+#ifndef CLIENTCONNECTION_H
+#define CLIENTCONNECTION_H
+
+#include <QObject>
+#include <QSslSocket>
+#include <QTimer>
+#include <QStringList>
+#include <QVector>
+#include <QPair>
+#include <QHash>
+#include "outbox.h"
+#include "filetransfer.h"
+
+struct ChatLine
+{
+    enum Kind {
+        Live, // Пришло только что (FROM, BCAST)
+        History, // Ответ на HISTORY
+        HistoryEnd, // Конец страницы истории, в text — число сообщений на странице
+        Sent, // Своё сообщение, отправленное не из окна чата (ссылка на загруженный файл)
+        Delivered // Сервер сохранил своё сообщение под id; показано раньше, как Sent или из окна
+    };
+
+    Kind kind = Live;
+    QString conversation; // Имя собеседника или "ALL" для общего чата
+    QString sender;
+    QString text;
+    quint64 id = 0;
+    quint64 traceId = 0; // Кадр пришёл с префиксом трассы задержки
+    qint64 receivedNs = 0; // Когда прочитан из сокета, для отрезка client.deliver
+};
+
+// Всё, что пришло с сервера за один кадр интерфейса
+struct ClientBatch
+{
+    QVector<ChatLine> messages;
+    QStringList users;
+    bool hasUsers = false; // users содержит свежий список
+    QVector<QPair<QString, bool>> presence; // JOIN (true) и LEAVE (false), пришедшие после users
+    QStringList statuses;
+    bool loggedIn = false;
+    QString username; // С каким именем сервер подтвердил вход, вместе с loggedIn
+};
+
+Q_DECLARE_METATYPE(ClientBatch)
+
+// Единственный владелец сокета клиента, работает в отдельном потоке.
+// Режет входящий поток на строки и разбирает каждую один раз, а результаты
+// копит и отдаёт GUI-потоку пачкой не чаще раза в кадр (batchReady).
+// Публичные методы можно вызывать из любого потока.
+//
+// При обрыве переподключается сам: первая попытка сразу, дальше с
+// экспоненциальной задержкой и случайным разбросом, перебирая адреса по
+// кругу. После входа сообщения идут через Outbox и SEND: при восстановлении
+// связи LOGIN и все неподтверждённые сообщения уходят одной записью.
+//
+// Файлы идут отдельными соединениями (FileTransfer) на порт, который сервер
+// сообщает в ответ на DATA, так что строки чата не ждут за большими файлами.
+class ClientConnection : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ClientConnection(QObject *parent = nullptr);
+
+    void connectToServer(const QStringList &endpoints); // Адреса вида "host:port" или "tls://host:port"
+    void setCaCertificates(const QList<QSslCertificate> &certificates); // Дополнительно к системным
+    void login(const QString &username, const QString &password);
+    void sendCommand(const QString &command);
+    void sendChatMessage(const QString &recipient, const QString &text);
+    void requestHistory(const QString &conversation, quint64 afterId, int limit);
+    void sendFile(const QString &recipient, const QString &path);
+    void downloadFile(const Attachment &attachment, const QString &path);
+
+signals:
+    void batchReady(const ClientBatch &batch);
+
+private slots:
+    void onReadyRead();
+    void onConnected();
+    void onEncrypted();
+    void onSslErrors(const QList<QSslError> &errors);
+    void onStateChanged(QAbstractSocket::SocketState state);
+    void reconnect();
+    void flushBatch();
+
+private:
+    static constexpr int frameInterval = 16; // мс, примерно один кадр при 60 Гц
+    static constexpr int initialBackoff = 100; // мс, задержка второй попытки
+    static constexpr int maxBackoff = 30000;
+    static constexpr int maxTransferAttempts = 5;
+    static constexpr int transferRetryDelay = 2000; // мс
+
+    QSslSocket *socket; // Без шифрования работает как обычный QTcpSocket
+    QTimer *flushTimer;
+    QTimer *reconnectTimer;
+    QTimer *retryTimer;
+    QByteArray readBuffer; // Недочитанная строка
+    ClientBatch pending;
+
+    QStringList endpoints;
+    int endpointIndex = 0;
+    int attempt = 0; // Неудачных попыток подряд
+    bool useTls = false; // Текущий адрес с префиксом tls://
+    QSslConfiguration sslConfiguration; // Сохраняет билет TLS-сессии между переподключениями
+    bool stopped = true; // Не переподключаться (ещё не запускались или сессию забрали)
+
+    QString username;
+    QString password; // Только в памяти, для повторного входа после обрыва
+    QString resumeToken; // Из SESSION, заменяет пароль при переподключении
+    bool sessionStarted = false; // LOGIN или RESUME отправлен в текущее соединение
+    bool awaitingLogin = false;
+    Outbox outbox;
+
+    QString dataHost;
+    quint16 dataPort = 0;
+    QByteArray dataToken; // Действует, пока живёт текущая сессия
+    QVector<FileTransfer*> queuedTransfers; // Ждут токена файлового канала
+
+    struct TracedSend
+    {
+        quint64 traceId = 0;
+        qint64 sentNs = 0;
+    };
+    QHash<quint64, TracedSend> tracedSends; // Номер SEND -> трасса, до ACK
+
+    bool isReady() const;
+    void startSession();
+    void writeCommand(const QString &command);
+    void processLine(const QString &line);
+    void scheduleFlush();
+    void sendNextRetry();
+    FileTransfer *createTransfer(FileTransfer::Direction direction, const QString &path,
+                                 const QString &recipient, const Attachment &attachment);
+    void startTransfer(FileTransfer *transfer);
+    void onTransferFinished(FileTransfer *transfer, bool ok, const QString &error);
+};
+
+#endif // CLIENTCONNECTION_H
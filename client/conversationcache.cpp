@@ -0,0 +1,173 @@
+#include "conversationcache.h"
+#include <QDir>
+#include <cstddef>
+
+ConversationCache::~ConversationCache()
+{
+    unmap();
+}
+
+bool ConversationCache::open(const QString &directory, const QString &conversation)
+{
+    QDir dir(directory);
+    if (!dir.exists() && !dir.mkpath(".")) return false;
+
+    // Имя беседы приходит с сервера, в имя файла берём его hex
+    QString name = QString::fromLatin1(conversation.toUtf8().toHex());
+    logFile.setFileName(dir.filePath(name + ".log"));
+    indexFile.setFileName(dir.filePath(name + ".idx"));
+    if (!logFile.open(QIODevice::ReadWrite) || !indexFile.open(QIODevice::ReadWrite)) {
+        logFile.close();
+        indexFile.close();
+        return false;
+    }
+
+    // Недописанную запись после аварийного завершения отбрасываем
+    rows = int(indexFile.size() / qint64(sizeof(IndexEntry)));
+    trimToIndex();
+
+    // Ненулевые id идут по возрастанию, так что максимум — последний ненулевой
+    remap();
+    for (int row = mappedRows - 1; row >= 0 && maxId == 0; --row) {
+        maxId = indexMap[row].id;
+    }
+    return true;
+}
+
+bool ConversationCache::isOpen() const
+{
+    return logFile.isOpen();
+}
+
+int ConversationCache::count() const
+{
+    return rows;
+}
+
+QString ConversationCache::text(int row)
+{
+    if (row < 0 || row >= rows) return QString();
+    if (row >= mappedRows) remap();
+    if (row >= mappedRows) return QString();
+
+    qint64 begin = qint64(indexMap[row].offset);
+    qint64 end = row + 1 < mappedRows ? qint64(indexMap[row + 1].offset) : mappedLogSize;
+    if (begin >= end || end > mappedLogSize) return QString();
+
+    return QString::fromUtf8(reinterpret_cast<const char *>(logMap + begin), int(end - begin - 1)); // Без '\n'
+}
+
+quint64 ConversationCache::id(int row)
+{
+    if (row < 0 || row >= rows) return 0;
+    if (row >= mappedRows) remap();
+    if (row >= mappedRows) return 0;
+    return indexMap[row].id;
+}
+
+quint64 ConversationCache::lastId() const
+{
+    return maxId;
+}
+
+void ConversationCache::append(const QString &line, quint64 id)
+{
+    if (!isOpen()) return;
+
+    QString text = line;
+    QByteArray bytes = text.replace('\n', ' ').toUtf8() + '\n';
+
+    IndexEntry entry;
+    entry.offset = quint64(logFile.size());
+    entry.id = id;
+
+    logFile.seek(logFile.size());
+    indexFile.seek(indexFile.size());
+    if (logFile.write(bytes) != bytes.size()) return;
+    if (indexFile.write(reinterpret_cast<const char *>(&entry), sizeof(entry)) != sizeof(entry)) return;
+
+    ++rows;
+    maxId = qMax(maxId, id);
+}
+
+void ConversationCache::setId(int row, quint64 id)
+{
+    if (!isOpen() || row < 0 || row >= rows) return;
+
+    // Пишем через файл: отображение видит ту же страницу
+    quint64 value = id;
+    indexFile.seek(qint64(row) * qint64(sizeof(IndexEntry)) + qint64(offsetof(IndexEntry, id)));
+    if (indexFile.write(reinterpret_cast<const char *>(&value), sizeof(value)) != sizeof(value)) return;
+    indexFile.flush();
+    maxId = qMax(maxId, id);
+}
+
+void ConversationCache::flush()
+{
+    logFile.flush();
+    indexFile.flush();
+}
+
+void ConversationCache::trimToIndex()
+{
+    // .log дописывается раньше .idx, поэтому после сбоя в конце .log могут
+    // остаться байты без записи в индексе. Если их не срезать, следующая
+    // строка встанет за ними, а последняя проиндексированная прочитается до неё.
+    // Индекс без целой строки в .log (файлы сбрасываются по отдельности)
+    // тоже отбрасываем.
+    qint64 logSize = logFile.size();
+    qint64 end = 0;
+    while (rows > 0) {
+        IndexEntry entry;
+        indexFile.seek(qint64(rows - 1) * qint64(sizeof(IndexEntry)));
+        if (indexFile.read(reinterpret_cast<char *>(&entry), sizeof(entry)) == sizeof(entry)
+            && entry.offset < quint64(logSize)) {
+            logFile.seek(qint64(entry.offset));
+            qint64 position = qint64(entry.offset);
+            while (end == 0 && !logFile.atEnd()) {
+                QByteArray chunk = logFile.read(4096);
+                if (chunk.isEmpty()) break;
+                int newline = chunk.indexOf('\n');
+                if (newline >= 0) end = position + newline + 1;
+                position += chunk.size();
+            }
+            if (end > 0) break;
+        }
+        --rows;
+    }
+
+    indexFile.resize(qint64(rows) * qint64(sizeof(IndexEntry)));
+    if (end < logSize) logFile.resize(end);
+}
+
+void ConversationCache::remap()
+{
+    unmap();
+    flush();
+    if (rows == 0) return;
+
+    qint64 logSize = logFile.size();
+    qint64 indexSize = qint64(rows) * qint64(sizeof(IndexEntry));
+    uchar *log = logSize > 0 ? logFile.map(0, logSize) : nullptr;
+    uchar *index = indexFile.map(0, indexSize);
+    if (!log || !index) {
+        if (log) logFile.unmap(log);
+        if (index) indexFile.unmap(index);
+        return;
+    }
+
+    logMap = log;
+    indexMap = reinterpret_cast<const IndexEntry *>(index);
+    mappedRows = rows;
+    mappedLogSize = logSize;
+}
+
+void ConversationCache::unmap()
+{
+    if (logMap) logFile.unmap(const_cast<uchar *>(logMap));
+    if (indexMap) indexFile.unmap(reinterpret_cast<uchar *>(const_cast<IndexEntry *>(indexMap)));
+    logMap = nullptr;
+    indexMap = nullptr;
+    mappedRows = 0;
+    mappedLogSize = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef CONVERSATIONCACHE_H
+#define CONVERSATIONCACHE_H
+
+#include <QFile>
+#include <QString>
+
+// Локальный кеш одной беседы на диске.
+// <имя>.log — строки переписки в UTF-8 через '\n', только дописываются.
+// <имя>.idx — по 16 байт на строку: смещение в .log и id сообщения на сервере
+// (0 для своих сообщений и тех, что сервер не сохранил).
+// Оба файла отображаются в память, поэтому открытие не зависит от длины
+// истории, а в памяти оказываются только прочитанные страницы.
+class ConversationCache
+{
+public:
+    ~ConversationCache();
+
+    bool open(const QString &directory, const QString &conversation);
+    bool isOpen() const;
+
+    int count() const;
+    QString text(int row);
+    quint64 id(int row);
+    quint64 lastId() const; // Наибольший id сервера в кеше, от него догружается история
+
+    void append(const QString &line, quint64 id);
+    void setId(int row, quint64 id); // Своё сообщение получило id на сервере
+    void flush();
+
+private:
+    struct IndexEntry
+    {
+        quint64 offset;
+        quint64 id;
+    };
+
+    QFile logFile;
+    QFile indexFile;
+    int rows = 0;
+    quint64 maxId = 0;
+
+    const uchar *logMap = nullptr;
+    const IndexEntry *indexMap = nullptr;
+    int mappedRows = 0;
+    qint64 mappedLogSize = 0;
+
+    void trimToIndex();
+    void remap();
+    void unmap();
+};
+
+#endif // CONVERSATIONCACHE_H
@@ -0,0 +1,238 @@
+#include "filetransfer.h"
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QPair>
+#include <QPointer>
+#include <QThreadPool>
+
+namespace {
+// Запускает work в пуле, а done с результатом — в потоке owner, если тот ещё
+// жив. QPointer проверяется только в потоке owner: в пуле это гонка с его
+// удалением. Посредник создаётся здесь же и удаляется в том же потоке.
+template<typename Work, typename Done>
+void runInPool(QObject *owner, Work work, Done done)
+{
+    QPointer<QObject> guard(owner);
+    QObject *relay = new QObject;
+    QThreadPool::globalInstance()->start([guard, relay, work, done]() {
+        auto result = work();
+        QMetaObject::invokeMethod(relay, [guard, relay, result, done]() {
+            relay->deleteLater();
+            if (guard) done(result);
+        });
+    });
+}
+}
+
+QString Attachment::toText() const
+{
+    return QString("/file %1 %2 %3").arg(hash, QString::number(size), name);
+}
+
+bool Attachment::parse(const QString &text, Attachment &attachment)
+{
+    if (!text.startsWith("/file ")) return false;
+
+    bool isNumber = false;
+    attachment.hash = text.section(' ', 1, 1);
+    attachment.size = text.section(' ', 2, 2).toLongLong(&isNumber);
+    attachment.name = text.section(' ', 3);
+    return isNumber && attachment.size >= 0 && attachment.hash.size() == 64 && !attachment.name.isEmpty();
+}
+
+FileTransfer::FileTransfer(Direction direction, const QString &path, const QString &recipient,
+                           const Attachment &attachment, QObject *parent)
+    : QObject(parent)
+    , dir(direction)
+    , filePath(path)
+    , peer(recipient)
+    , info(attachment)
+    , socket(new QTcpSocket(this))
+{
+    connect(socket, &QTcpSocket::connected, this, &FileTransfer::onConnected);
+    connect(socket, &QTcpSocket::readyRead, this, &FileTransfer::onReadyRead);
+    connect(socket, &QTcpSocket::bytesWritten, this, &FileTransfer::onBytesWritten);
+    connect(socket, &QTcpSocket::disconnected, this, &FileTransfer::onDisconnected);
+    connect(socket, &QTcpSocket::errorOccurred, this, &FileTransfer::onDisconnected);
+}
+
+void FileTransfer::start(const QString &host, quint16 port, const QByteArray &token)
+{
+    this->token = token;
+    ++attemptCount;
+    interrupted = false;
+
+    if (dir == Download || !info.hash.isEmpty()) {
+        connectToChannel(host, port);
+        return;
+    }
+
+    // Хеш большого файла считается долго, поток соединения на это время не занимаем
+    state = Hashing;
+    QString path = filePath;
+    runInPool(this, [path]() {
+        return qMakePair(sha256(path), QFileInfo(path).size());
+    }, [this, host, port](const QPair<QString, qint64> &result) {
+        if (state != Hashing) return;
+        if (result.first.isEmpty()) {
+            finish(false, "Cannot read " + filePath);
+            return;
+        }
+        info.hash = result.first;
+        info.size = result.second;
+        connectToChannel(host, port);
+    });
+}
+
+QString FileTransfer::sha256(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return QString();
+
+    QCryptographicHash digest(QCryptographicHash::Sha256);
+    if (!digest.addData(&file)) return QString();
+    return QString::fromLatin1(digest.result().toHex());
+}
+
+void FileTransfer::connectToChannel(const QString &host, quint16 port)
+{
+    state = AwaitingReply;
+    socket->connectToHost(host, port);
+}
+
+void FileTransfer::onConnected()
+{
+    if (dir == Upload) {
+        socket->write("PUT " + token + " " + info.hash.toLatin1() + " " + QByteArray::number(info.size) + "\n");
+        return;
+    }
+
+    // Продолжаем с конца недокачанного файла
+    offset = QFileInfo(filePath + ".part").size();
+    if (offset > info.size) {
+        QFile::remove(filePath + ".part");
+        offset = 0;
+    }
+    socket->write("GET " + token + " " + info.hash.toLatin1() + " " + QByteArray::number(offset) + "\n");
+}
+
+void FileTransfer::onReadyRead()
+{
+    while (state != Idle && state != Verifying) {
+        if (state == Receiving) {
+            receiveChunks();
+            return;
+        }
+        if (!socket->canReadLine()) return;
+        processReply(socket->readLine().trimmed());
+    }
+}
+
+void FileTransfer::onBytesWritten()
+{
+    if (state == Sending) sendChunks();
+}
+
+void FileTransfer::onDisconnected()
+{
+    if (state == Receiving) receiveChunks(); // Хвост мог прийти вместе с закрытием
+    if (state == AwaitingReply || state == Sending || state == AwaitingStored || state == Receiving) {
+        finish(false, "Connection lost: " + socket->errorString(), true);
+    }
+}
+
+void FileTransfer::processReply(const QByteArray &reply)
+{
+    QList<QByteArray> parts = reply.split(' ');
+    if (parts[0] == "ERROR") {
+        finish(false, QString::fromUtf8(reply.mid(6)));
+    } else if (state == AwaitingReply && dir == Upload && parts[0] == "OFFSET") {
+        // Сервер говорит, сколько у него уже есть; если весь файл — следом придёт STORED
+        offset = parts.value(1).toLongLong();
+        file.setFileName(filePath);
+        if (!file.open(QIODevice::ReadOnly) || !file.seek(offset)) {
+            finish(false, "Cannot read " + filePath);
+            return;
+        }
+        state = Sending;
+        sendChunks();
+    } else if (state == AwaitingReply && dir == Download && parts[0] == "SIZE") {
+        if (parts.value(1).toLongLong() != info.size) {
+            finish(false, "File size does not match");
+            return;
+        }
+        file.setFileName(filePath + ".part");
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            finish(false, "Cannot write " + file.fileName());
+            return;
+        }
+        state = Receiving;
+    } else if ((state == Sending || state == AwaitingStored) && parts[0] == "STORED") {
+        finish(true, QString());
+    } else {
+        finish(false, "Unexpected reply: " + QString::fromUtf8(reply));
+    }
+}
+
+void FileTransfer::sendChunks()
+{
+    // Кладём в сокет понемногу, следующую порцию — по bytesWritten
+    while (offset < info.size && socket->bytesToWrite() < maxInFlight) {
+        QByteArray chunk = file.read(qMin(chunkSize, info.size - offset));
+        if (chunk.isEmpty()) {
+            finish(false, "File changed during upload: " + filePath);
+            return;
+        }
+        socket->write(chunk);
+        offset += chunk.size();
+    }
+    if (offset >= info.size) state = AwaitingStored;
+}
+
+void FileTransfer::receiveChunks()
+{
+    while (offset < info.size && socket->bytesAvailable() > 0) {
+        QByteArray chunk = socket->read(qMin(socket->bytesAvailable(), info.size - offset));
+        if (file.write(chunk) != chunk.size()) {
+            finish(false, "Cannot write " + file.fileName());
+            return;
+        }
+        offset += chunk.size();
+    }
+    if (offset >= info.size) verifyDownload();
+}
+
+void FileTransfer::verifyDownload()
+{
+    file.close();
+    state = Verifying;
+    socket->abort();
+
+    QString partialPath = filePath + ".part";
+    runInPool(this, [partialPath]() {
+        return sha256(partialPath);
+    }, [this, partialPath](const QString &hash) {
+        if (hash != info.hash) {
+            QFile::remove(partialPath); // Докачивать испорченное бессмысленно
+            finish(false, "Downloaded file is corrupted");
+            return;
+        }
+        QFile::remove(filePath);
+        if (!QFile::rename(partialPath, filePath)) {
+            finish(false, "Cannot write " + filePath);
+            return;
+        }
+        finish(true, QString());
+    });
+}
+
+void FileTransfer::finish(bool ok, const QString &error, bool resumable)
+{
+    if (state == Idle) return;
+
+    state = Idle;
+    interrupted = resumable;
+    file.close();
+    socket->abort();
+    emit finished(ok, error);
+}
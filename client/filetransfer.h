@@ -0,0 +1,81 @@
+#ifndef FILETRANSFER_H
+#define FILETRANSFER_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QFile>
+
+// Ссылка на вложение в тексте сообщения: "/file <sha256> <размер> <имя>".
+// Само содержимое идёт отдельным соединением, в чате только эта строка,
+// поэтому вложения попадают в историю, поиск и кеш как обычные сообщения.
+struct Attachment
+{
+    QString hash;
+    qint64 size = 0;
+    QString name;
+
+    QString toText() const;
+    static bool parse(const QString &text, Attachment &attachment);
+};
+
+// Одна передача файла через файловый канал сервера (PUT или GET), живёт в
+// потоке ClientConnection. После обрыва start() можно вызвать снова:
+// загрузка продолжится с того, что сервер уже принял, скачивание — с конца
+// файла <путь>.part.
+class FileTransfer : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Direction { Upload, Download };
+
+    FileTransfer(Direction direction, const QString &path, const QString &recipient,
+                 const Attachment &attachment, QObject *parent = nullptr);
+
+    Direction direction() const { return dir; }
+    QString recipient() const { return peer; }
+    Attachment attachment() const { return info; }
+    QString path() const { return filePath; }
+    int attempts() const { return attemptCount; }
+    bool canResume() const { return interrupted; } // Оборвалось соединение, а не отказал сервер
+
+    void start(const QString &host, quint16 port, const QByteArray &token);
+
+    static QString sha256(const QString &path); // Пустая строка, если файл не прочитать
+
+signals:
+    void finished(bool ok, const QString &error);
+
+private slots:
+    void onConnected();
+    void onReadyRead();
+    void onBytesWritten();
+    void onDisconnected();
+
+private:
+    enum State { Idle, Hashing, AwaitingReply, Sending, AwaitingStored, Receiving, Verifying };
+
+    static constexpr qint64 chunkSize = 64 * 1024;
+    static constexpr qint64 maxInFlight = 256 * 1024; // Больше в буфер сокета не кладём
+
+    Direction dir;
+    QString filePath;
+    QString peer;
+    Attachment info;
+    QTcpSocket *socket;
+    QFile file;
+    State state = Idle;
+    qint64 offset = 0;
+    QByteArray token;
+    int attemptCount = 0;
+    bool interrupted = false;
+
+    void connectToChannel(const QString &host, quint16 port);
+    void processReply(const QByteArray &reply);
+    void sendChunks();
+    void receiveChunks();
+    void verifyDownload();
+    void finish(bool ok, const QString &error, bool resumable = false);
+};
+
+#endif // FILETRANSFER_H
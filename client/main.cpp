@@ -4,6 +4,7 @@
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    a.setApplicationName("SimpleChat"); // Каталог локального кеша и настроек
     MainWindow w;
     w.show();
     return a.exec();
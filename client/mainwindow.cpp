@@ -3,28 +3,56 @@
 #include "registerdialog.h"
 #include "logindialog.h"
 #include "chatwindow.h"
+#include <QSettings>
+#include <QSslCertificate>
+#include <QStandardPaths>
+#include "latencytrace.h"
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
-    , socket(new QTcpSocket(this))
+    , connection(new ClientConnection)
+    , roster(new RosterModel(this))
 {
     ui->setupUi(this);
+    ui->userListView->setModel(roster);
 
     connect(ui->registerButton, &QPushButton::clicked, this, &MainWindow::onRegisterButtonClicked);
     connect(ui->loginButton, &QPushButton::clicked, this, &MainWindow::onLoginButtonClicked);
     connect(ui->selectUserButton, &QPushButton::clicked, this, &MainWindow::onSelectUserButtonClicked);
+    connect(ui->userListView, &QListView::activated, this, &MainWindow::onSelectUserButtonClicked);
+    connect(ui->filterLineEdit, &QLineEdit::textChanged, roster, &RosterModel::setFilter);
 
-    connect(socket, &QTcpSocket::readyRead, this, &MainWindow::onReadyRead);
+    networkThread.setObjectName("network"); // Имя потока в файле трассы задержки
+    connection->moveToThread(&networkThread);
+    connect(&networkThread, &QThread::finished, connection, &QObject::deleteLater);
+    connect(connection, &ClientConnection::batchReady, this, &MainWindow::onBatchReady);
+    networkThread.start();
 
-    // Подключаемся к серверу
-    socket->connectToHost("192.168.120.179", 1234); // Замените IP на адрес вашего сервера
+    // Подключаемся к серверу, адреса перебираются по кругу при обрывах
+    QSettings settings;
+    QString caFile = settings.value("tlsCaFile").toString(); // Например, server.crt из gen-cert.sh
+    if (!caFile.isEmpty()) {
+        connection->setCaCertificates(QSslCertificate::fromPath(caFile));
+    }
+    QStringList endpoints = settings.value("endpoints", QStringList() << "192.168.120.179:1234").toStringList();
+    connection->connectToServer(endpoints);
+
+    // Трасса задержки для каждого N-го отправленного сообщения, пишется при выходе
+    int traceSampleEvery = settings.value("traceSampleEvery", 0).toInt();
+    if (traceSampleEvery > 0) LatencyTrace::setEnabled(true, traceSampleEvery);
 
     loadUserList();
 }
 
 MainWindow::~MainWindow()
 {
+    networkThread.quit();
+    networkThread.wait();
+    if (LatencyTrace::isEnabled()) {
+        QString directory = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+        LatencyTrace::dump(directory + QString("/trace-client-%1.json").arg(QCoreApplication::applicationPid()), "client");
+    }
     delete ui;
 }
 
@@ -42,35 +70,69 @@ void MainWindow::onLoginButtonClicked()
 {
     LoginDialog loginDialog(this);
     if (loginDialog.exec() == QDialog::Accepted) {
-        QString username = loginDialog.getUsername();
-        QString password = loginDialog.getPassword();
-        sendCommand("LOGIN " + username + " " + password);
+        // Профиль кеша выберем, когда сервер подтвердит вход под этим именем
+        connection->login(loginDialog.getUsername(), loginDialog.getPassword());
     }
 }
 
 void MainWindow::onSelectUserButtonClicked()
 {
-    QString selectedUser = ui->userListWidget->currentItem()->text();
+    QString selectedUser = roster->name(ui->userListView->currentIndex().row());
     if (!selectedUser.isEmpty()) {
         openChatWindow(selectedUser);
     }
 }
 
-void MainWindow::onReadyRead()
+void MainWindow::onBatchReady(const ClientBatch &batch)
 {
-    QString response = QString::fromUtf8(socket->readAll()).trimmed();
-    QStringList lines = response.split("\n");
-
-    ui->userListWidget->clear();
-
-    for (const QString &line : lines) {
-        if (line.startsWith("OK Logged in successfully")) {
-            loadUserList();
-        } else if (line.startsWith("ERROR")) {
-            ui->statusLabel->setText(line);
-        } else if (!line.isEmpty()) {
-            ui->userListWidget->addItem(line);
+    if (!batch.statuses.isEmpty()) {
+        ui->statusLabel->setText(batch.statuses.last());
+    }
+    if (batch.hasUsers) {
+        roster->setUsers(batch.users);
+    }
+    for (const auto &change : batch.presence) {
+        if (change.second) {
+            roster->insert(change.first);
+        } else {
+            roster->remove(change.first);
+        }
+    }
+    if (batch.loggedIn) {
+        if (batch.username != username) {
+            // Окна прошлого пользователя пишут в чужой кеш
+            qDeleteAll(chatWindows);
+            chatWindows.clear();
+            username = batch.username;
+        }
+        loggedIn = true;
+        loadUserList();
+        for (ChatWindow *chatWindow : qAsConst(chatWindows)) {
+            chatWindow->startSync();
+        }
+    }
+
+    // Группируем по беседам, чтобы каждое окно обновлялось один раз за пачку
+    QStringList order;
+    QHash<QString, QVector<ChatLine>> messages;
+    for (const ChatLine &message : batch.messages) {
+        // Свои сообщения в общий чат сервер возвращает отправителю, они уже показаны как "Me"
+        if (message.kind == ChatLine::Live && message.conversation == "ALL" && message.sender == username) continue;
+
+        auto it = messages.find(message.conversation);
+        if (it == messages.end()) {
+            order.append(message.conversation);
+            it = messages.insert(message.conversation, QVector<ChatLine>());
         }
+        it->append(message);
+    }
+    for (const QString &conversation : qAsConst(order)) {
+        openChatWindow(conversation)->receive(messages.value(conversation));
+    }
+
+    // От чтения из сокета до показа: пачка, переход в поток GUI и отрисовка моделей
+    for (const ChatLine &message : batch.messages) {
+        if (message.traceId) LatencyTrace::record("client.deliver", message.traceId, message.receivedNs, LatencyTrace::now());
     }
 }
 
@@ -79,15 +141,25 @@ void MainWindow::loadUserList()
     sendCommand("LIST");
 }
 
-void MainWindow::openChatWindow(const QString &username)
+ChatWindow *MainWindow::openChatWindow(const QString &peer)
 {
-    ChatWindow *chatWindow = new ChatWindow(username, socket, this);
+    ChatWindow *chatWindow = chatWindows.value(peer);
+    if (!chatWindow) {
+        // До подтверждённого входа переписка живёт только в памяти окна
+        QString cacheDirectory;
+        if (!username.isEmpty()) {
+            cacheDirectory = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)
+                    + "/cache/" + username;
+        }
+        chatWindow = new ChatWindow(peer, username, cacheDirectory, connection, this);
+        chatWindows.insert(peer, chatWindow);
+        if (loggedIn) chatWindow->startSync();
+    }
     chatWindow->show();
+    return chatWindow;
 }
 
 void MainWindow::sendCommand(const QString &command)
 {
-    if (socket->state() == QTcpSocket::ConnectedState) {
-        socket->write((command + "\n").toUtf8());
-    }
+    connection->sendCommand(command);
 }
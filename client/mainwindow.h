@@ -2,12 +2,17 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QTcpSocket>
+#include <QHash>
+#include <QThread>
+#include "clientconnection.h"
+#include "rostermodel.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
 
+class ChatWindow;
+
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -20,14 +25,19 @@ private slots:
     void onRegisterButtonClicked();
     void onLoginButtonClicked();
     void onSelectUserButtonClicked();
-    void onReadyRead();
+    void onBatchReady(const ClientBatch &batch);
 
 private:
     Ui::MainWindow *ui;
-    QTcpSocket *socket;
+    QThread networkThread; // Сокет и разбор протокола живут здесь, а не в GUI-потоке
+    ClientConnection *connection;
+    RosterModel *roster;
+    QHash<QString, ChatWindow*> chatWindows; // Открытые беседы по имени собеседника
+    QString username; // Под каким именем сервер подтвердил последний вход
+    bool loggedIn = false;
 
     void loadUserList();
-    void openChatWindow(const QString &username);
+    ChatWindow *openChatWindow(const QString &peer);
     void sendCommand(const QString &command);
 };
 
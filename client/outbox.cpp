@@ -0,0 +1,155 @@
+#include "outbox.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QSaveFile>
+#include <QTextStream>
+
+bool Outbox::open(const QString &path)
+{
+    file.close();
+    queue.clear();
+    deferred.clear();
+    id.clear();
+    // Без сохранённого номера начинаем от текущего времени, чтобы номера
+    // не пересеклись с уже виденными сервером после переустановки клиента
+    nextSequence = quint64(QDateTime::currentMSecsSinceEpoch()) * 1000;
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    file.setFileName(path);
+
+    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QTextStream in(&file);
+        in.setCodec("UTF-8");
+        while (!in.atEnd()) {
+            QString line = in.readLine();
+            QString type = line.section(' ', 0, 0);
+            quint64 sequence = line.section(' ', 1, 1).toULongLong();
+            if (type == "Q" && sequence != 0) {
+                OutgoingMessage message;
+                message.sequence = sequence;
+                message.recipient = line.section(' ', 2, 2);
+                message.text = line.section(' ', 3);
+                queue.append(message);
+                nextSequence = qMax(nextSequence, sequence + 1);
+            } else if (type == "A") {
+                for (int i = 0; i < queue.size(); ++i) {
+                    if (queue[i].sequence == sequence) {
+                        queue.remove(i);
+                        break;
+                    }
+                }
+            } else if (type == "N") {
+                nextSequence = qMax(nextSequence, sequence);
+            } else if (type == "C") {
+                id = line.section(' ', 1, 1);
+            }
+        }
+        file.close();
+    }
+    if (id.isEmpty()) id = QString::number(QRandomGenerator::system()->generate64(), 16);
+
+    compact();
+    return file.open(QIODevice::Append | QIODevice::Text);
+}
+
+bool Outbox::isOpen() const
+{
+    return file.isOpen();
+}
+
+QString Outbox::clientId() const
+{
+    return id;
+}
+
+const QVector<OutgoingMessage> &Outbox::pending() const
+{
+    return queue;
+}
+
+OutgoingMessage Outbox::enqueue(const QString &recipient, const QString &text)
+{
+    OutgoingMessage message;
+    message.sequence = nextSequence++;
+    message.recipient = recipient;
+    message.text = QString(text).replace('\n', ' ');
+    queue.append(message);
+    if (!deferred.isEmpty()) deferred.append(message.sequence);
+
+    appendLine(QString("Q %1 %2 %3").arg(message.sequence).arg(message.recipient, message.text));
+    return message;
+}
+
+bool Outbox::remove(quint64 sequence, OutgoingMessage *message)
+{
+    // Подтверждения приходят по порядку, поэтому нужное почти всегда первое
+    bool found = false;
+    for (int i = 0; i < queue.size(); ++i) {
+        if (queue[i].sequence == sequence) {
+            if (message) *message = queue[i];
+            queue.remove(i);
+            appendLine(QString("A %1").arg(sequence));
+            found = true;
+            break;
+        }
+    }
+
+    if (queue.isEmpty() && file.isOpen() && file.size() > 64 * 1024) {
+        file.close();
+        compact();
+        file.open(QIODevice::Append | QIODevice::Text);
+    }
+    return found;
+}
+
+OutgoingMessage Outbox::requeue(quint64 sequence)
+{
+    // Старый номер сервер уже учёл, повтор под ним он отбросил бы как DUP
+    OutgoingMessage message;
+    if (!remove(sequence, &message)) return OutgoingMessage();
+    message = enqueue(message.recipient, message.text);
+    if (deferred.isEmpty()) deferred.append(message.sequence);
+    return message;
+}
+
+OutgoingMessage Outbox::takeDeferred()
+{
+    while (!deferred.isEmpty()) {
+        quint64 sequence = deferred.takeFirst();
+        for (const OutgoingMessage &message : qAsConst(queue)) {
+            if (message.sequence == sequence) return message;
+        }
+        // Ответ на него уже пришёл после переподключения
+    }
+    return OutgoingMessage();
+}
+
+void Outbox::clearDeferred()
+{
+    deferred.clear();
+}
+
+void Outbox::compact()
+{
+    QSaveFile out(file.fileName());
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Text)) return;
+
+    QTextStream stream(&out);
+    stream.setCodec("UTF-8");
+    stream << "C " << id << "\n";
+    stream << "N " << nextSequence << "\n";
+    for (const OutgoingMessage &message : qAsConst(queue)) {
+        stream << "Q " << message.sequence << " " << message.recipient << " " << message.text << "\n";
+    }
+    stream.flush();
+    out.commit();
+}
+
+void Outbox::appendLine(const QString &line)
+{
+    if (!file.isOpen()) return;
+    file.write((line + "\n").toUtf8());
+    file.flush();
+}
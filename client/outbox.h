@@ -0,0 +1,53 @@
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+struct OutgoingMessage
+{
+    quint64 sequence = 0;
+    QString recipient;
+    QString text;
+};
+
+// Очередь исходящих сообщений, переживающая обрыв связи и перезапуск.
+// Файл — журнал строк "Q <номер> <получатель> <текст>" (поставлено) и
+// "A <номер>" (сервер принял или отказал окончательно). При открытии журнал
+// сжимается до неподтверждённых сообщений и строк "N <следующий номер>" и
+// "C <id клиента>". Номера растут только внутри одной очереди, поэтому
+// сервер сравнивает их отдельно для каждого id клиента (CLIENT).
+//
+// Сервер помечает номер принятым сразу при получении и отбрасывает как DUP
+// всё, что не больше последнего. Поэтому сообщения уходят строго по
+// возрастанию номеров: пока есть отложенные (RETRY), новые встают за ними,
+// а не уходят сразу.
+class Outbox
+{
+public:
+    bool open(const QString &path);
+    bool isOpen() const;
+
+    QString clientId() const; // Случайный, создаётся с новой очередью
+    const QVector<OutgoingMessage> &pending() const;
+    OutgoingMessage enqueue(const QString &recipient, const QString &text); // При отложенных встаёт за ними
+    bool remove(quint64 sequence, OutgoingMessage *message = nullptr); // false, если такого номера нет в очереди
+    OutgoingMessage requeue(quint64 sequence); // То же сообщение в конец очереди под новым номером, отложенным; sequence 0, если не нашлось
+
+    bool hasDeferred() const { return !deferred.isEmpty(); } // Тогда новое сообщение не отправляется сразу
+    OutgoingMessage takeDeferred(); // Следующее отложенное, ещё ждущее ответа; sequence 0, если таких нет
+    void clearDeferred(); // Вся очередь ушла заново с новой сессией
+
+private:
+    QFile file;
+    QVector<OutgoingMessage> queue;
+    QVector<quint64> deferred; // По возрастанию: номера выдаются по порядку и сразу сюда
+    quint64 nextSequence = 0;
+    QString id;
+
+    void compact();
+    void appendLine(const QString &line);
+};
+
+#endif // OUTBOX_H
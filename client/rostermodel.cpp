@@ -0,0 +1,149 @@
+#include "rostermodel.h"
+#include <algorithm>
+
+RosterModel::RosterModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
+}
+
+int RosterModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) return 0;
+    return filterEnd - filterBegin;
+}
+
+QVariant RosterModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || role != Qt::DisplayRole) return QVariant();
+    return name(index.row());
+}
+
+QString RosterModel::name(int row) const
+{
+    if (row < 0 || row >= rowCount()) return QString();
+    return entries[filterBegin + row].name;
+}
+
+void RosterModel::setUsers(const QStringList &users)
+{
+    QVector<Entry> fresh;
+    fresh.reserve(users.size());
+    for (const QString &user : users) {
+        fresh.append(makeEntry(user));
+    }
+    std::sort(fresh.begin(), fresh.end());
+    fresh.erase(std::unique(fresh.begin(), fresh.end(), [](const Entry &a, const Entry &b) {
+        return a.name == b.name;
+    }), fresh.end());
+
+    // Слиянием двух отсортированных списков находим разницу со старым
+    QStringList added, removed;
+    int i = 0, j = 0;
+    while (i < entries.size() || j < fresh.size()) {
+        if (j == fresh.size() || (i < entries.size() && entries[i] < fresh[j])) {
+            removed << entries[i++].name;
+        } else if (i == entries.size() || fresh[j] < entries[i]) {
+            added << fresh[j++].name;
+        } else {
+            ++i;
+            ++j;
+        }
+    }
+
+    if (added.size() + removed.size() > maxIncrementalChanges) {
+        beginResetModel();
+        entries = fresh;
+        updateFilterRange();
+        endResetModel();
+        return;
+    }
+
+    for (const QString &user : qAsConst(removed)) remove(user);
+    for (const QString &user : qAsConst(added)) insert(user);
+}
+
+void RosterModel::insert(const QString &name)
+{
+    Entry entry = makeEntry(name);
+    int position = find(entry);
+    if (position < entries.size() && entries[position].name == name) return; // Уже в списке
+
+    if (matchesFilter(entry)) {
+        int row = position - filterBegin;
+        beginInsertRows(QModelIndex(), row, row);
+        entries.insert(position, entry);
+        ++filterEnd;
+        endInsertRows();
+    } else {
+        entries.insert(position, entry);
+        if (entry.key < filter) { // Не подходящие под фильтр ключи меньше префикса стоят перед диапазоном
+            ++filterBegin;
+            ++filterEnd;
+        }
+    }
+}
+
+void RosterModel::remove(const QString &name)
+{
+    int position = find(makeEntry(name));
+    if (position >= entries.size() || entries[position].name != name) return;
+
+    if (position >= filterBegin && position < filterEnd) {
+        int row = position - filterBegin;
+        beginRemoveRows(QModelIndex(), row, row);
+        entries.remove(position);
+        --filterEnd;
+        endRemoveRows();
+    } else {
+        entries.remove(position);
+        if (position < filterBegin) {
+            --filterBegin;
+            --filterEnd;
+        }
+    }
+}
+
+void RosterModel::setFilter(const QString &prefix)
+{
+    QString folded = prefix.trimmed().toCaseFolded();
+    if (folded == filter) return;
+
+    beginResetModel();
+    filter = folded;
+    updateFilterRange();
+    endResetModel();
+}
+
+bool RosterModel::Entry::operator<(const Entry &other) const
+{
+    return key < other.key || (key == other.key && name < other.name);
+}
+
+RosterModel::Entry RosterModel::makeEntry(const QString &name)
+{
+    Entry entry;
+    entry.key = name.toCaseFolded();
+    entry.name = name;
+    return entry;
+}
+
+int RosterModel::find(const Entry &entry) const
+{
+    return int(std::lower_bound(entries.constBegin(), entries.constEnd(), entry) - entries.constBegin());
+}
+
+bool RosterModel::matchesFilter(const Entry &entry) const
+{
+    return entry.key.startsWith(filter);
+}
+
+void RosterModel::updateFilterRange()
+{
+    // Все ключи с префиксом filter идут подряд, начиная с первого ключа не меньше filter
+    auto begin = std::lower_bound(entries.constBegin(), entries.constEnd(), filter,
+                                  [](const Entry &entry, const QString &prefix) { return entry.key < prefix; });
+    auto end = std::partition_point(begin, entries.constEnd(),
+                                    [this](const Entry &entry) { return matchesFilter(entry); });
+    filterBegin = int(begin - entries.constBegin());
+    filterEnd = int(end - entries.constBegin());
+}
@@ -0,0 +1,51 @@
+#ifndef ROSTERMODEL_H
+#define ROSTERMODEL_H
+
+#include <QAbstractListModel>
+#include <QStringList>
+#include <QVector>
+
+// Список пользователей онлайн, отсортированный по имени без учёта регистра.
+// Изменения приходят точечно (insert/remove) и превращаются в вставку или
+// удаление одной строки, так что выделение в виде не сбрасывается.
+// Отсортированный массив одновременно служит префиксным индексом: строки,
+// начинающиеся с фильтра, лежат подряд, и видимый диапазон ищется за O(log n).
+class RosterModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    explicit RosterModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    QString name(int row) const;
+
+    void setUsers(const QStringList &users); // Полный список, применяется как набор изменений
+    void insert(const QString &name);
+    void remove(const QString &name);
+    void setFilter(const QString &prefix);
+
+private:
+    struct Entry
+    {
+        QString key; // Имя в свёрнутом регистре, по нему идёт сортировка и фильтр
+        QString name;
+        bool operator<(const Entry &other) const;
+    };
+
+    static constexpr int maxIncrementalChanges = 64; // Больше — проще сбросить модель
+
+    QVector<Entry> entries;
+    QString filter;
+    int filterBegin = 0; // Видимые строки — entries[filterBegin, filterEnd)
+    int filterEnd = 0;
+
+    static Entry makeEntry(const QString &name);
+    int find(const Entry &entry) const; // Позиция вставки (lower bound)
+    bool matchesFilter(const Entry &entry) const;
+    void updateFilterRange();
+};
+
+#endif // ROSTERMODEL_H
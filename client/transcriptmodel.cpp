@@ -0,0 +1,70 @@
+#include "transcriptmodel.h"
+
+TranscriptModel::TranscriptModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
+}
+
+bool TranscriptModel::open(const QString &directory, const QString &conversation)
+{
+    beginResetModel();
+    bool opened = cache.open(directory, conversation);
+    endResetModel();
+    return opened;
+}
+
+quint64 TranscriptModel::lastId() const
+{
+    return cache.lastId();
+}
+
+int TranscriptModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) return 0;
+    return cache.isOpen() ? cache.count() : memoryRows.size();
+}
+
+QVariant TranscriptModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || role != Qt::DisplayRole) return QVariant();
+    return text(index.row());
+}
+
+QString TranscriptModel::text(int row) const
+{
+    if (!cache.isOpen()) return memoryRows.value(row);
+    return cache.text(row);
+}
+
+bool TranscriptModel::assignId(const QString &line, quint64 id)
+{
+    if (!cache.isOpen()) return memoryRows.lastIndexOf(line) >= 0; // id в памяти не хранятся
+
+    int last = cache.count() - 1;
+    for (int row = last; row >= 0 && row > last - assignSearchRows; --row) {
+        if (cache.id(row) == 0 && cache.text(row) == line) {
+            cache.setId(row, id);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TranscriptModel::appendLines(const QStringList &lines, const QVector<quint64> &ids)
+{
+    if (lines.isEmpty()) return;
+
+    int first = rowCount();
+    beginInsertRows(QModelIndex(), first, first + lines.size() - 1);
+
+    if (!cache.isOpen()) {
+        memoryRows += lines;
+    } else {
+        for (int i = 0; i < lines.size(); ++i) {
+            cache.append(lines[i], ids.value(i));
+        }
+        cache.flush();
+    }
+
+    endInsertRows();
+}
@@ -0,0 +1,36 @@
+#ifndef TRANSCRIPTMODEL_H
+#define TRANSCRIPTMODEL_H
+
+#include <QAbstractListModel>
+#include <QStringList>
+#include <QVector>
+#include "conversationcache.h"
+
+// Строки переписки одной беседы поверх локального кеша (ConversationCache).
+// Кеш отображён в память, поэтому модель ничего не держит сама: вид читает
+// только видимые строки, а далёкая история остаётся на диске.
+class TranscriptModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    explicit TranscriptModel(QObject *parent = nullptr);
+
+    bool open(const QString &directory, const QString &conversation);
+    quint64 lastId() const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    QString text(int row) const;
+    void appendLines(const QStringList &lines, const QVector<quint64> &ids = QVector<quint64>());
+    bool assignId(const QString &line, quint64 id); // Последней такой строке без id; false, если не нашлась
+
+private:
+    static constexpr int assignSearchRows = 1000; // Дальше от конца неподтверждённые строки не ищем
+
+    mutable ConversationCache cache;
+    QStringList memoryRows; // Если кеш на диске открыть не удалось
+};
+
+#endif // TRANSCRIPTMODEL_H
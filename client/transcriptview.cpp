@@ -0,0 +1,131 @@
+#include "transcriptview.h"
+#include "transcriptmodel.h"
+#include <QMouseEvent>
+#include <QPainter>
+#include <QScrollBar>
+#include <climits>
+
+TranscriptView::TranscriptView(QWidget *parent) : QAbstractScrollArea(parent)
+{
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    verticalScrollBar()->setSingleStep(1);
+}
+
+void TranscriptView::setModel(TranscriptModel *model)
+{
+    if (this->model) disconnect(this->model, nullptr, this, nullptr);
+
+    this->model = model;
+    if (model) {
+        connect(model, &TranscriptModel::rowsInserted, this, &TranscriptView::onRowsInserted);
+        connect(model, &TranscriptModel::modelReset, this, &TranscriptView::onModelReset);
+    }
+    onModelReset();
+}
+
+void TranscriptView::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    if (!model) return;
+
+    QPainter painter(viewport());
+    painter.setPen(palette().color(QPalette::Text));
+
+    int width = viewport()->width() - 2 * margin;
+    int height = viewport()->height();
+    int rows = model->rowCount();
+
+    // Рисуем от первой видимой строки, пока не заполнится окно
+    int y = margin;
+    for (int row = verticalScrollBar()->value(); row < rows && y < height; ++row) {
+        int rowHeightPx = rowHeight(row);
+        painter.drawText(QRect(margin, y, width, rowHeightPx), Qt::TextWordWrap, model->text(row));
+        y += rowHeightPx;
+    }
+}
+
+int TranscriptView::rowAt(int y) const
+{
+    if (!model || y < margin) return -1;
+
+    // Тот же обход, что и при рисовании
+    int top = margin;
+    int rows = model->rowCount();
+    for (int row = verticalScrollBar()->value(); row < rows && top < viewport()->height(); ++row) {
+        top += rowHeight(row);
+        if (y < top) return row;
+    }
+    return -1;
+}
+
+void TranscriptView::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    int row = rowAt(event->pos().y());
+    if (row >= 0) emit rowDoubleClicked(row);
+}
+
+void TranscriptView::scrollContentsBy(int dx, int dy)
+{
+    Q_UNUSED(dx);
+    Q_UNUSED(dy);
+    viewport()->update(); // Прокрутка по строкам, сдвиг в пикселях не имеет смысла
+}
+
+void TranscriptView::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+
+    if (viewport()->width() != cachedWidth) {
+        cachedWidth = viewport()->width();
+        rowHeights.fill(-1); // Переносы зависят от ширины
+    }
+    updateScrollRange();
+}
+
+void TranscriptView::onRowsInserted()
+{
+    // Если пользователь был внизу, остаёмся внизу и после вставки
+    bool following = verticalScrollBar()->value() >= verticalScrollBar()->maximum();
+    rowHeights.resize(model->rowCount(), -1);
+    updateScrollRange();
+    if (following) verticalScrollBar()->setValue(verticalScrollBar()->maximum());
+    viewport()->update();
+}
+
+void TranscriptView::onModelReset()
+{
+    rowHeights.fill(-1, model ? model->rowCount() : 0);
+    updateScrollRange();
+    verticalScrollBar()->setValue(verticalScrollBar()->maximum());
+    viewport()->update();
+}
+
+int TranscriptView::rowHeight(int row) const
+{
+    int &height = rowHeights[row];
+    if (height < 0) {
+        QRect bounds(0, 0, viewport()->width() - 2 * margin, INT_MAX / 2);
+        height = fontMetrics().boundingRect(bounds, Qt::TextWordWrap, model->text(row)).height() + rowSpacing;
+        height = qMax(height, fontMetrics().height() + rowSpacing);
+    }
+    return height;
+}
+
+void TranscriptView::updateScrollRange()
+{
+    int rows = model ? model->rowCount() : 0;
+
+    // Максимум — первая строка, с которой последние строки ровно заполняют окно.
+    // Идём с конца, поэтому считаются высоты только последнего экрана.
+    int available = viewport()->height() - 2 * margin;
+    int first = rows;
+    while (first > 0 && available >= rowHeight(first - 1)) {
+        available -= rowHeight(first - 1);
+        --first;
+    }
+    if (first == rows && rows > 0) --first; // Последняя строка выше окна
+    int visibleRows = rows - first;
+
+    verticalScrollBar()->setRange(0, qMax(0, first));
+    verticalScrollBar()->setPageStep(qMax(1, visibleRows));
+}
@@ -0,0 +1,48 @@
+#ifndef TRANSCRIPTVIEW_H
+#define TRANSCRIPTVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QVector>
+
+class TranscriptModel;
+
+// Вид переписки, который раскладывает и рисует только видимые строки.
+// Прокрутка идёт по строкам: значение полосы прокрутки — номер первой
+// видимой строки. Высота строки с переносами считается при первом показе
+// и кешируется до изменения ширины.
+class TranscriptView : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    explicit TranscriptView(QWidget *parent = nullptr);
+
+    void setModel(TranscriptModel *model);
+    int rowAt(int y) const; // -1, если под точкой нет строки
+
+signals:
+    void rowDoubleClicked(int row);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+
+private slots:
+    void onRowsInserted();
+    void onModelReset();
+
+private:
+    static constexpr int margin = 4;
+    static constexpr int rowSpacing = 2;
+
+    TranscriptModel *model = nullptr;
+    mutable QVector<int> rowHeights; // -1, пока строка ни разу не показывалась
+    int cachedWidth = -1;
+
+    int rowHeight(int row) const;
+    void updateScrollRange();
+};
+
+#endif // TRANSCRIPTVIEW_H
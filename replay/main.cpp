@@ -0,0 +1,103 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QFile>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <QTimer>
+#include "replayer.h"
+
+// Печатает метрики прогона и, если задан эталон, их изменение в процентах
+static void printReport(const QJsonObject &report, const QJsonObject &baseline)
+{
+    QTextStream out(stdout);
+    auto line = [&](const QString &name, double value, double base) {
+        out << name.leftJustified(16) << QString::number(value, 'f', 3);
+        if (base > 0) {
+            out << "  (baseline " << QString::number(base, 'f', 3)
+                << ", " << QString::number((value - base) / base * 100.0, 'f', 1) << "%)";
+        }
+        out << "\n";
+    };
+
+    for (const QString &key : { "frames", "duration_ms", "frames_per_sec", "lines_received", "errors", "probes_lost", "resume_skipped" }) {
+        line(key, report[key].toDouble(), baseline[key].toDouble());
+    }
+
+    QJsonObject latency = report["latency_ms"].toObject();
+    QJsonObject baseLatency = baseline["latency_ms"].toObject();
+    for (const QString &key : { "p50", "p90", "p99", "max" }) {
+        line("latency_" + key + "_ms", latency[key].toDouble(), baseLatency[key].toDouble());
+    }
+
+    if (report["drain_timed_out"].toBool()) {
+        out << "warning: the server did not answer the final probes in time, frames_per_sec is a lower bound\n";
+    }
+    if (report["resume_skipped"].toDouble() > 0) {
+        out << "warning: RESUME frames cannot be replayed (tokens belong to the captured server), "
+               "their sessions ran without login\n";
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays a server capture file and reports throughput and latency.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("trace", "Capture file written by server --capture.");
+    QCommandLineOption hostOption("host", "Server address.", "host", "127.0.0.1");
+    QCommandLineOption portOption("port", "Server port.", "port", "1234");
+    QCommandLineOption fastOption("fast", "Send frames as fast as possible instead of the original pace.");
+    QCommandLineOption probeOption("probe-interval", "PING probe interval in ms, 0 disables probes.", "ms", "100");
+    QCommandLineOption jsonOption("json", "Write the report as JSON to a file.", "file");
+    QCommandLineOption compareOption("compare", "JSON report of a previous run to compare against.", "file");
+    parser.addOptions({ hostOption, portOption, fastOption, probeOption, jsonOption, compareOption });
+    parser.process(a);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+
+    Replayer::Options options;
+    options.host = parser.value(hostOption);
+    options.port = quint16(parser.value(portOption).toUInt());
+    options.fast = parser.isSet(fastOption);
+    options.probeInterval = parser.value(probeOption).toInt();
+
+    QJsonObject baseline;
+    if (parser.isSet(compareOption)) {
+        QFile file(parser.value(compareOption));
+        if (!file.open(QIODevice::ReadOnly)) {
+            qCritical() << "Cannot open baseline" << file.fileName();
+            return 1;
+        }
+        baseline = QJsonDocument::fromJson(file.readAll()).object();
+    }
+
+    Replayer replayer(options);
+    QString error;
+    if (!replayer.load(parser.positionalArguments().first(), &error)) {
+        qCritical() << "Cannot load trace:" << error;
+        return 1;
+    }
+
+    QObject::connect(&replayer, &Replayer::finished, &a, [&]() {
+        QJsonObject report = replayer.report();
+        printReport(report, baseline);
+
+        if (parser.isSet(jsonOption)) {
+            QFile file(parser.value(jsonOption));
+            if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                file.write(QJsonDocument(report).toJson());
+            } else {
+                qCritical() << "Cannot write report" << file.fileName();
+            }
+        }
+        a.quit();
+    });
+
+    QTimer::singleShot(0, &replayer, &Replayer::start);
+    return a.exec();
+}
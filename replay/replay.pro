@@ -0,0 +1,22 @@
+QT += core network
+QT -= gui
+
+CONFIG += c++17 console
+
+TEMPLATE = app
+
+TARGET = replay
+
+OBJECTS_DIR = $$PWD/obj
+MOC_DIR = $$PWD/moc
+RCC_DIR = $$PWD/rcc
+
+INCLUDEPATH += $$PWD/../server
+
+SOURCES += main.cpp \
+           replayer.cpp
+
+HEADERS += replayer.h \
+           ../server/traceformat.h
+
+DESTDIR = $$PWD/../bin
@@ -0,0 +1,315 @@
+#include "replayer.h"
+#include "traceformat.h"
+#include <QFile>
+#include <algorithm>
+#include <cstring>
+
+// Кадр может начинаться с префикса трассы "@t=<hex> "
+static bool isResume(const QByteArray &frame)
+{
+    QByteArray command = frame.startsWith("@t=") ? frame.mid(frame.indexOf(' ') + 1) : frame;
+    return command.startsWith("RESUME ");
+}
+
+Replayer::Replayer(const Options &options, QObject *parent)
+    : QObject(parent)
+    , options(options)
+{
+    dispatchTimer.setSingleShot(true);
+    dispatchTimer.setTimerType(Qt::PreciseTimer);
+    connect(&dispatchTimer, &QTimer::timeout, this, &Replayer::dispatch);
+
+    probeTimer.setInterval(options.probeInterval);
+    connect(&probeTimer, &QTimer::timeout, this, &Replayer::sendProbes);
+
+    drainTimer.setSingleShot(true);
+    connect(&drainTimer, &QTimer::timeout, this, [this]() {
+        drainTimedOut = true;
+        finish();
+    });
+}
+
+bool Replayer::load(const QString &path, QString *error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = file.errorString();
+        return false;
+    }
+
+    QByteArray data = file.readAll();
+    const char *pos = data.constData();
+    const char *end = pos + data.size();
+    if (data.size() < 5 || memcmp(pos, TraceFormat::magic, sizeof(TraceFormat::magic)) != 0) {
+        *error = "not a trace file";
+        return false;
+    }
+    if (quint8(pos[4]) != TraceFormat::version) {
+        *error = "unsupported trace version";
+        return false;
+    }
+    pos += 5;
+
+    qint64 time = 0;
+    while (pos < end) {
+        TraceRecord record;
+        record.type = quint8(*pos++);
+
+        quint64 connectionId, delta;
+        if (!TraceFormat::readVarint(pos, end, connectionId) || !TraceFormat::readVarint(pos, end, delta)) break;
+        time += qint64(delta);
+        record.connectionId = quint32(connectionId);
+        record.time = time;
+
+        if (record.type == TraceFormat::Frame) {
+            quint64 length;
+            if (!TraceFormat::readVarint(pos, end, length) || quint64(end - pos) < length) break;
+            record.data = QByteArray(pos, int(length));
+            pos += length;
+        } else if (record.type != TraceFormat::Connect && record.type != TraceFormat::Disconnect) {
+            *error = "corrupt trace record";
+            return false;
+        }
+        records.append(record);
+    }
+    return true;
+}
+
+void Replayer::start()
+{
+    clock.start();
+    if (options.probeInterval > 0) probeTimer.start();
+    dispatch();
+}
+
+void Replayer::dispatch()
+{
+    qint64 now = clock.nsecsElapsed();
+
+    // Порциями, чтобы сокеты успевали отправлять данные между вызовами
+    int budget = 1000;
+    while (next < records.size() && budget > 0) {
+        const TraceRecord &record = records[next];
+        if (!options.fast && record.time > now) break;
+        apply(record);
+        ++next;
+        --budget;
+    }
+    lastDispatch = clock.nsecsElapsed();
+
+    if (next < records.size()) {
+        qint64 wait = options.fast || budget == 0 ? 0 : (records[next].time - now) / 1000000;
+        dispatchTimer.start(int(wait));
+        return;
+    }
+
+    // Всё отправлено, но сервер мог ещё не обработать и половины, особенно с
+    // --fast. Последний PING на каждое соединение: его PONG придёт после
+    // ответов на всё отправленное раньше, тогда и заканчивается замер
+    draining = true;
+    probeTimer.stop();
+    for (auto it = connections.begin(); it != connections.end(); ++it) {
+        if (!it->closing && (!it->connected || it->socket->state() == QAbstractSocket::ConnectedState)) {
+            sendProbe(*it);
+        }
+    }
+    if (outstandingProbes() == 0) {
+        finish();
+    } else {
+        drainTimer.start(drainTimeout);
+    }
+}
+
+void Replayer::sendProbes()
+{
+    for (auto it = connections.begin(); it != connections.end(); ++it) {
+        if (!it->connected || it->closing) continue;
+        sendProbe(*it);
+    }
+}
+
+void Replayer::sendProbe(Connection &connection)
+{
+    if (connection.connected) {
+        connection.socket->write("PING\n");
+    } else {
+        connection.pending.append("PING\n");
+    }
+    connection.probes.append(clock.nsecsElapsed());
+    ++probesSent;
+}
+
+void Replayer::finish()
+{
+    if (done) return;
+    done = true;
+    finishedAt = clock.nsecsElapsed();
+
+    dispatchTimer.stop();
+    probeTimer.stop();
+    drainTimer.stop();
+    for (auto it = connections.begin(); it != connections.end(); ++it) {
+        probesLost += it->probes.size();
+        it->probes.clear();
+        it->socket->abort();
+    }
+    emit finished();
+}
+
+QJsonObject Replayer::report() const
+{
+    QVector<qint64> sorted = latencies;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted](double p) {
+        if (sorted.isEmpty()) return 0.0;
+        int index = qMin(sorted.size() - 1, int(p * sorted.size()));
+        return sorted[index] / 1e6;
+    };
+
+    // До ответа сервера на всё отправленное: время одной отправки ничего не говорит о его скорости
+    double seconds = finishedAt / 1e9;
+    QJsonObject latency;
+    latency["p50"] = percentile(0.50);
+    latency["p90"] = percentile(0.90);
+    latency["p99"] = percentile(0.99);
+    latency["max"] = sorted.isEmpty() ? 0.0 : sorted.last() / 1e6;
+
+    QJsonObject result;
+    result["mode"] = options.fast ? "fast" : "paced";
+    result["frames"] = double(framesSent);
+    result["bytes"] = double(bytesSent);
+    result["dispatch_ms"] = lastDispatch / 1e6;
+    result["duration_ms"] = seconds * 1e3;
+    result["drain_timed_out"] = drainTimedOut;
+    result["resume_skipped"] = double(resumeSkipped);
+    result["frames_per_sec"] = seconds > 0 ? framesSent / seconds : 0.0;
+    result["lines_received"] = double(linesReceived);
+    result["errors"] = double(errorsReceived);
+    result["probes"] = double(probesSent);
+    result["probes_lost"] = double(probesLost);
+    result["latency_ms"] = latency;
+    return result;
+}
+
+void Replayer::apply(const TraceRecord &record)
+{
+    switch (record.type) {
+    case TraceFormat::Connect:
+        openConnection(record.connectionId);
+        break;
+    case TraceFormat::Frame:
+        if (isResume(record.data)) {
+            // Токен выдан серверу, на котором шёл захват; сессия останется без входа
+            ++resumeSkipped;
+            break;
+        }
+        if (record.data.trimmed() == "PING") {
+            // Записанный PING тоже служит пробой
+            auto it = connections.find(record.connectionId);
+            if (it != connections.end()) {
+                it->probes.append(clock.nsecsElapsed());
+                ++probesSent;
+            }
+        }
+        send(record.connectionId, record.data + '\n');
+        break;
+    case TraceFormat::Disconnect: {
+        auto it = connections.find(record.connectionId);
+        if (it == connections.end()) break;
+        if (it->connected) {
+            it->socket->disconnectFromHost(); // Сначала допишет буфер
+        } else {
+            it->closing = true;
+        }
+        break;
+    }
+    }
+}
+
+void Replayer::openConnection(quint32 connectionId)
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+    Connection connection;
+    connection.socket = socket;
+    connections.insert(connectionId, connection);
+
+    connect(socket, &QTcpSocket::connected, this, [this, connectionId]() { onConnected(connectionId); });
+    connect(socket, &QTcpSocket::readyRead, this, [this, connectionId]() { onReadyRead(connectionId); });
+    connect(socket, &QTcpSocket::disconnected, this, [this, connectionId]() { onDisconnected(connectionId); });
+    socket->connectToHost(options.host, options.port);
+}
+
+void Replayer::send(quint32 connectionId, const QByteArray &frame)
+{
+    auto it = connections.find(connectionId);
+    if (it == connections.end()) return;
+
+    if (it->connected) {
+        it->socket->write(frame);
+    } else {
+        it->pending.append(frame);
+    }
+    ++framesSent;
+    bytesSent += frame.size();
+}
+
+void Replayer::onConnected(quint32 connectionId)
+{
+    auto it = connections.find(connectionId);
+    if (it == connections.end()) return;
+
+    it->connected = true;
+    if (!it->pending.isEmpty()) {
+        it->socket->write(it->pending);
+        it->pending.clear();
+    }
+    if (it->closing) it->socket->disconnectFromHost();
+}
+
+void Replayer::onReadyRead(quint32 connectionId)
+{
+    auto it = connections.find(connectionId);
+    if (it == connections.end()) return;
+
+    it->readBuffer.append(it->socket->readAll());
+    int start = 0, newline;
+    while ((newline = it->readBuffer.indexOf('\n', start)) != -1) {
+        QByteArray line = it->readBuffer.mid(start, newline - start).trimmed();
+        start = newline + 1;
+        ++linesReceived;
+
+        if (line == "PONG" && !it->probes.isEmpty()) {
+            latencies.append(clock.nsecsElapsed() - it->probes.takeFirst());
+        } else if (line == "PING") {
+            it->socket->write("PONG\n"); // Иначе сервер закроет соединение по таймауту
+        } else if (line.startsWith("ERROR")) {
+            ++errorsReceived;
+        }
+    }
+    it->readBuffer.remove(0, start);
+
+    if (draining && outstandingProbes() == 0) finish();
+}
+
+void Replayer::onDisconnected(quint32 connectionId)
+{
+    if (done) return; // Сокеты закрывает finish(), таблицу соединений не трогаем
+
+    auto it = connections.find(connectionId);
+    if (it == connections.end()) return;
+
+    probesLost += it->probes.size();
+    it->socket->deleteLater();
+    connections.erase(it);
+
+    if (draining && outstandingProbes() == 0) finish();
+}
+
+int Replayer::outstandingProbes() const
+{
+    int count = 0;
+    for (const Connection &connection : connections) {
+        count += connection.probes.size();
+    }
+    return count;
+}
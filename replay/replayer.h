@@ -0,0 +1,102 @@
+#ifndef REPLAYER_H
+#define REPLAYER_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QVector>
+#include <QJsonObject>
+
+struct TraceRecord
+{
+    quint8 type = 0;
+    quint32 connectionId = 0;
+    qint64 time = 0; // нс от начала захвата
+    QByteArray data;
+};
+
+// Воспроизводит файл захвата против запущенного сервера: открывает по
+// соединению на каждый записанный id и отправляет кадры в исходном темпе
+// или так быстро, как получится. Задержка измеряется пробами PING/PONG:
+// сервер отвечает на них в порядке очереди, поэтому время ответа включает
+// обработку всего, что было отправлено на соединение раньше. Прогон
+// заканчивается, когда на последний PING каждого соединения пришёл PONG,
+// то есть сервер обработал всё отправленное. Кадры RESUME не отправляются:
+// токены из захвата к этому серверу не подходят.
+class Replayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options
+    {
+        QString host = "127.0.0.1";
+        quint16 port = 1234;
+        bool fast = false;
+        int probeInterval = 100; // мс, 0 отключает пробы
+    };
+
+    explicit Replayer(const Options &options, QObject *parent = nullptr);
+
+    bool load(const QString &path, QString *error);
+    void start();
+    QJsonObject report() const;
+
+signals:
+    void finished();
+
+private slots:
+    void dispatch();
+    void sendProbes();
+    void finish();
+
+private:
+    struct Connection
+    {
+        QTcpSocket *socket = nullptr;
+        bool connected = false;
+        bool closing = false; // Disconnect пришёл до установки соединения
+        QByteArray pending; // Кадры, отправленные до установки соединения
+        QByteArray readBuffer;
+        QVector<qint64> probes; // Время отправки PING, ждущих PONG
+    };
+
+    Options options;
+    QVector<TraceRecord> records;
+    int next = 0;
+    QHash<quint32, Connection> connections;
+
+    QElapsedTimer clock;
+    QTimer dispatchTimer;
+    QTimer probeTimer;
+    QTimer drainTimer;
+    bool draining = false;
+    bool done = false;
+
+    static constexpr int drainTimeout = 60000; // мс ожидания последних PONG
+
+    qint64 lastDispatch = 0; // нс
+    qint64 finishedAt = 0; // нс, когда сервер ответил на все пробы или истёк drainTimeout
+    bool drainTimedOut = false;
+    quint64 framesSent = 0;
+    quint64 bytesSent = 0;
+    quint64 linesReceived = 0;
+    quint64 errorsReceived = 0;
+    quint64 probesSent = 0;
+    quint64 probesLost = 0;
+    quint64 resumeSkipped = 0;
+    QVector<qint64> latencies; // нс
+
+    void apply(const TraceRecord &record);
+    void openConnection(quint32 connectionId);
+    void send(quint32 connectionId, const QByteArray &frame);
+    void sendProbe(Connection &connection);
+    void onConnected(quint32 connectionId);
+    void onReadyRead(quint32 connectionId);
+    void onDisconnected(quint32 connectionId);
+    int outstandingProbes() const;
+};
+
+#endif // REPLAYER_H
@@ -0,0 +1,283 @@
+#include "accountstore.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QVector>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+std::shared_ptr<AccountSnapshot> AccountSnapshot::open(const QString &path)
+{
+    auto snapshot = std::make_shared<AccountSnapshot>();
+    snapshot->file.setFileName(path);
+    if (!snapshot->file.open(QIODevice::ReadOnly)) return nullptr;
+
+    snapshot->size = snapshot->file.size();
+    if (snapshot->size < headerSize) return nullptr;
+    snapshot->data = snapshot->file.map(0, snapshot->size);
+    if (!snapshot->data) return nullptr;
+
+    const uchar *data = snapshot->data;
+    if (qFromLittleEndian<quint32>(data) != magic || qFromLittleEndian<quint32>(data + 4) != version) return nullptr;
+    snapshot->recordCount = qFromLittleEndian<quint64>(data + 8);
+    snapshot->coveredBytes = qint64(qFromLittleEndian<quint64>(data + 16));
+    quint64 tableOffset = qFromLittleEndian<quint64>(data + 24);
+
+    // Только проверка размеров: записи проверяются при чтении, старт не зависит от их числа
+    if (tableOffset > quint64(snapshot->size) || (quint64(snapshot->size) - tableOffset) / 8 < snapshot->recordCount) {
+        return nullptr;
+    }
+    snapshot->table = data + tableOffset;
+    return snapshot;
+}
+
+const uchar *AccountSnapshot::record(quint64 index) const
+{
+    quint64 offset = qFromLittleEndian<quint64>(table + index * 8);
+    if (offset + recordHeaderSize > quint64(size)) return nullptr;
+
+    const uchar *record = data + offset;
+    quint64 length = quint64(qFromLittleEndian<quint32>(record)) + qFromLittleEndian<quint32>(record + 4);
+    if (offset + recordHeaderSize + length > quint64(size)) return nullptr;
+    return record;
+}
+
+bool AccountSnapshot::find(const QByteArray &name, Account &account) const
+{
+    quint64 low = 0;
+    quint64 high = recordCount;
+    while (low < high) {
+        quint64 middle = low + (high - low) / 2;
+        const uchar *entry = record(middle);
+        if (!entry) return false;
+
+        // Тот же порядок, что у QByteArray при записи: побайтово, короткое раньше
+        int nameLength = int(qFromLittleEndian<quint32>(entry));
+        int order = std::memcmp(entry + recordHeaderSize, name.constData(), size_t(qMin(nameLength, name.size())));
+        if (order == 0) order = nameLength - name.size();
+
+        if (order < 0) {
+            low = middle + 1;
+        } else if (order > 0) {
+            high = middle;
+        } else {
+            account = accountAt(middle);
+            return true;
+        }
+    }
+    return false;
+}
+
+QByteArray AccountSnapshot::nameAt(quint64 index) const
+{
+    const uchar *entry = record(index);
+    if (!entry) return QByteArray();
+    return QByteArray(reinterpret_cast<const char *>(entry + recordHeaderSize), int(qFromLittleEndian<quint32>(entry)));
+}
+
+Account AccountSnapshot::accountAt(quint64 index) const
+{
+    Account account;
+    const uchar *entry = record(index);
+    if (!entry) return account;
+
+    int nameLength = int(qFromLittleEndian<quint32>(entry));
+    account.password = QByteArray(reinterpret_cast<const char *>(entry + recordHeaderSize + nameLength),
+                                  int(qFromLittleEndian<quint32>(entry + 4)));
+    return account;
+}
+
+// Выполняется в пуле: сливает отсортированный старый снимок с изменениями
+bool AccountSnapshot::write(const QString &path, const AccountSnapshot *base,
+                            const QHash<QString, Account> &changes, qint64 logOffset)
+{
+    QVector<QPair<QByteArray, Account>> sorted;
+    sorted.reserve(changes.size());
+    for (auto it = changes.cbegin(); it != changes.cend(); ++it) {
+        sorted.append(qMakePair(it.key().toUtf8(), it.value()));
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const QPair<QByteArray, Account> &a, const QPair<QByteArray, Account> &b) {
+        return a.first < b.first;
+    });
+
+    QSaveFile out(path);
+    if (!out.open(QIODevice::WriteOnly)) return false;
+
+    QByteArray buffer(headerSize, '\0'); // Заголовок допишем в конце, когда известны размеры
+    qint64 flushed = 0;
+    bool ok = true;
+    auto flush = [&](bool force) {
+        if (!force && buffer.size() < (1 << 20)) return;
+        ok = ok && out.write(buffer) == buffer.size();
+        flushed += buffer.size();
+        buffer.clear();
+    };
+
+    QVector<quint64> offsets;
+    offsets.reserve(int(base ? base->count() : 0) + sorted.size());
+    auto append = [&](const QByteArray &name, const Account &account) {
+        offsets.append(quint64(flushed + buffer.size()));
+        uchar head[recordHeaderSize];
+        qToLittleEndian<quint32>(quint32(name.size()), head);
+        qToLittleEndian<quint32>(quint32(account.password.size()), head + 4);
+        buffer.append(reinterpret_cast<const char *>(head), recordHeaderSize);
+        buffer.append(name);
+        buffer.append(account.password);
+        flush(false);
+    };
+
+    quint64 baseIndex = 0;
+    quint64 baseCount = base ? base->count() : 0;
+    int changeIndex = 0;
+    while (baseIndex < baseCount || changeIndex < sorted.size()) {
+        QByteArray baseName = baseIndex < baseCount ? base->nameAt(baseIndex) : QByteArray();
+        if (changeIndex >= sorted.size() || (baseIndex < baseCount && baseName < sorted[changeIndex].first)) {
+            append(baseName, base->accountAt(baseIndex++));
+        } else {
+            if (baseIndex < baseCount && baseName == sorted[changeIndex].first) ++baseIndex; // Изменение заменяет старую запись
+            append(sorted[changeIndex].first, sorted[changeIndex].second);
+            ++changeIndex;
+        }
+    }
+
+    quint64 tableOffset = quint64(flushed + buffer.size());
+    for (quint64 offset : qAsConst(offsets)) {
+        uchar bytes[8];
+        qToLittleEndian<quint64>(offset, bytes);
+        buffer.append(reinterpret_cast<const char *>(bytes), 8);
+        flush(false);
+    }
+    flush(true);
+
+    uchar header[headerSize];
+    qToLittleEndian<quint32>(magic, header);
+    qToLittleEndian<quint32>(version, header + 4);
+    qToLittleEndian<quint64>(quint64(offsets.size()), header + 8);
+    qToLittleEndian<quint64>(quint64(logOffset), header + 16);
+    qToLittleEndian<quint64>(tableOffset, header + 24);
+    ok = ok && out.seek(0) && out.write(reinterpret_cast<const char *>(header), headerSize) == headerSize;
+
+    if (!ok) {
+        out.cancelWriting();
+        return false;
+    }
+    return out.commit();
+}
+
+AccountStore::AccountStore(QObject *parent)
+    : QObject(parent)
+{
+    pool.setMaxThreadCount(1);
+}
+
+AccountStore::~AccountStore()
+{
+    pool.waitForDone(); // Запись держит копию base
+}
+
+bool AccountStore::open(const QString &usersPath, const QString &snapshotPath)
+{
+    this->snapshotPath = snapshotPath;
+    if (!QDir().mkpath(QFileInfo(snapshotPath).path())) return false;
+
+    base = AccountSnapshot::open(snapshotPath);
+    changes.clear();
+    logOffset = 0;
+
+    QFile users(usersPath);
+    if (!users.open(QIODevice::ReadOnly)) return true; // Пользователей ещё нет
+
+    qint64 offset = base ? base->logOffset() : 0;
+    if (offset > users.size()) {
+        base.reset(); // users.txt заменили целиком, снимок к нему не относится
+        offset = 0;
+    }
+
+    // Дочитываем только регистрации после снимка
+    users.seek(offset);
+    while (!users.atEnd()) {
+        QList<QByteArray> line = users.readLine().trimmed().split(' ');
+        if (line.size() < 2) continue;
+        QString username = QString::fromUtf8(line[0]);
+        if (!contains(username)) { // Как и раньше, при повторах действует первая строка
+            Account account;
+            account.password = line[1];
+            changes.insert(username, account);
+        }
+    }
+    logOffset = users.pos();
+    return true;
+}
+
+bool AccountStore::find(const QString &username, Account &account) const
+{
+    auto it = changes.constFind(username);
+    if (it != changes.cend()) {
+        account = it.value();
+        return true;
+    }
+    return base && base->find(username.toUtf8(), account);
+}
+
+bool AccountStore::contains(const QString &username) const
+{
+    Account account;
+    return find(username, account);
+}
+
+QString AccountStore::password(const QString &username) const
+{
+    Account account;
+    return find(username, account) ? QString::fromUtf8(account.password) : QString();
+}
+
+void AccountStore::addUser(const QString &username, const QString &password, qint64 logOffset)
+{
+    Account account;
+    account.password = password.toUtf8();
+    changes.insert(username, account);
+    this->logOffset = logOffset;
+}
+
+void AccountStore::saveSnapshot()
+{
+    if (saving || changes.isEmpty() || snapshotPath.isEmpty()) return;
+
+    // Копия QHash не копирует данные, пока сервер их не изменит
+    saving = true;
+    std::shared_ptr<AccountSnapshot> snapshot = base;
+    QHash<QString, Account> saved = changes;
+    qint64 covered = logOffset;
+    QString path = snapshotPath;
+    pool.start([this, snapshot, saved, covered, path]() {
+        QElapsedTimer timer;
+        timer.start();
+        bool ok = AccountSnapshot::write(path, snapshot.get(), saved, covered);
+        qint64 elapsed = timer.elapsed();
+        QMetaObject::invokeMethod(this, [this, ok, saved, elapsed]() {
+            finishSnapshot(ok, saved, elapsed);
+        });
+    });
+}
+
+void AccountStore::finishSnapshot(bool ok, const QHash<QString, Account> &saved, qint64 elapsedMs)
+{
+    saving = false;
+
+    std::shared_ptr<AccountSnapshot> snapshot = ok ? AccountSnapshot::open(snapshotPath) : nullptr;
+    if (snapshot) {
+        // Старое отображение живёт, пока на него ссылается запись; файл уже заменён
+        base = snapshot;
+        if (changes.isSharedWith(saved)) {
+            changes.clear(); // За время записи ничего не менялось
+        } else {
+            for (auto it = saved.cbegin(); it != saved.cend(); ++it) {
+                auto current = changes.find(it.key());
+                if (current != changes.end() && current.value() == it.value()) changes.erase(current);
+            }
+        }
+    }
+    emit snapshotSaved(bool(snapshot), snapshotCount(), elapsedMs);
+}
@@ -0,0 +1,98 @@
+#ifndef ACCOUNTSTORE_H
+#define ACCOUNTSTORE_H
+
+#include <QObject>
+#include <QFile>
+#include <QHash>
+#include <QThreadPool>
+#include <memory>
+
+struct Account
+{
+    QByteArray password;
+
+    bool operator==(const Account &other) const
+    {
+        return password == other.password;
+    }
+};
+
+// Снимок учётных записей, отображённый в память. Файл не разбирается при
+// открытии: записи лежат как есть, а таблица смещений в конце отсортирована
+// по имени (байты UTF-8), поэтому поиск — двоичный прямо по отображению.
+//
+// Формат (little-endian):
+//   заголовок: "SCST", версия (u32), число записей (u64),
+//              покрытая часть users.txt в байтах (u64), смещение таблицы (u64)
+//   записи:    длина имени (u32), длина пароля (u32), имя, пароль
+//   таблица:   смещение каждой записи (u64) в порядке имён
+class AccountSnapshot
+{
+public:
+    static std::shared_ptr<AccountSnapshot> open(const QString &path);
+
+    quint64 count() const { return recordCount; }
+    qint64 logOffset() const { return coveredBytes; }
+
+    bool find(const QByteArray &name, Account &account) const;
+    QByteArray nameAt(quint64 index) const;
+    Account accountAt(quint64 index) const;
+
+    static bool write(const QString &path, const AccountSnapshot *base,
+                      const QHash<QString, Account> &changes, qint64 logOffset);
+
+private:
+    static constexpr quint32 magic = 0x54534353; // "SCST"
+    static constexpr quint32 version = 2; // В версии 1 записи хранили номер SEND, теперь он в SequenceJournal
+    static constexpr int headerSize = 32;
+    static constexpr int recordHeaderSize = 8;
+
+    QFile file;
+    const uchar *data = nullptr;
+    qint64 size = 0;
+    quint64 recordCount = 0;
+    qint64 coveredBytes = 0;
+    const uchar *table = nullptr;
+
+    const uchar *record(quint64 index) const;
+};
+
+// Учётные записи сервера: снимок на диске плюс изменения после него.
+// users.txt остаётся журналом регистраций; при запуске читается только его
+// хвост, не попавший в снимок, так что время старта не зависит от числа
+// пользователей. Снимок периодически переписывается в фоне: изменения
+// копируются (copy-on-write QHash) и сливаются со старым снимком в пуле.
+class AccountStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AccountStore(QObject *parent = nullptr);
+    ~AccountStore();
+
+    bool open(const QString &usersPath, const QString &snapshotPath);
+    quint64 snapshotCount() const { return base ? base->count() : 0; }
+    int pendingChanges() const { return changes.size(); }
+
+    bool contains(const QString &username) const;
+    QString password(const QString &username) const;
+    void addUser(const QString &username, const QString &password, qint64 logOffset); // После записи в users.txt
+
+    void saveSnapshot(); // Ничего не делает, если сохранять нечего или запись уже идёт
+
+signals:
+    void snapshotSaved(bool ok, quint64 count, qint64 elapsedMs);
+
+private:
+    std::shared_ptr<AccountSnapshot> base;
+    QHash<QString, Account> changes; // Новые пользователи и изменения относительно base
+    QString snapshotPath;
+    qint64 logOffset = 0; // Сколько байт users.txt уже учтено
+    bool saving = false;
+    QThreadPool pool; // Один поток для записи снимка
+
+    bool find(const QString &username, Account &account) const;
+    void finishSnapshot(bool ok, const QHash<QString, Account> &saved, qint64 elapsedMs);
+};
+
+#endif // ACCOUNTSTORE_H
@@ -0,0 +1,90 @@
+#include "blobstore.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+bool BlobStore::open(const QString &directory)
+{
+    if (!QDir().mkpath(directory + "/partial")) return false;
+    rootPath = directory;
+    return true;
+}
+
+bool BlobStore::isValidHash(const QString &hash)
+{
+    if (hash.size() != 64) return false;
+    for (QChar c : hash) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+    }
+    return true;
+}
+
+bool BlobStore::contains(const QString &hash) const
+{
+    return QFile::exists(path(hash));
+}
+
+qint64 BlobStore::size(const QString &hash) const
+{
+    QFileInfo info(path(hash));
+    return info.exists() ? info.size() : -1;
+}
+
+QString BlobStore::path(const QString &hash) const
+{
+    // Первые два символа — подкаталог, чтобы не держать всё в одном каталоге
+    return rootPath + "/" + hash.left(2) + "/" + hash;
+}
+
+QString BlobStore::partialPath(const QString &hash) const
+{
+    return rootPath + "/partial/" + hash;
+}
+
+qint64 BlobStore::partialSize(const QString &hash) const
+{
+    QFileInfo info(partialPath(hash));
+    return info.exists() ? info.size() : 0;
+}
+
+bool BlobStore::commit(const QString &hash) const
+{
+    QFile partial(partialPath(hash));
+    if (!partial.open(QIODevice::ReadOnly)) return false;
+
+    QCryptographicHash digest(QCryptographicHash::Sha256);
+    bool readOk = digest.addData(&partial);
+    partial.close();
+    if (!readOk || QString::fromLatin1(digest.result().toHex()) != hash) {
+        partial.remove(); // Испорченные данные не докачать, начинаем заново
+        return false;
+    }
+
+    if (contains(hash)) {
+        partial.remove(); // Тот же файл успел загрузить кто-то другой
+        return true;
+    }
+    return QDir().mkpath(rootPath + "/" + hash.left(2)) && partial.rename(path(hash));
+}
+
+qint64 BlobStore::sweepPartials(qint64 maxAge, qint64 maxBytes, const QSet<QString> &active) const
+{
+    if (!isOpen()) return 0;
+
+    // Старые первыми: при нехватке места уходят они
+    const QFileInfoList files = QDir(rootPath + "/partial").entryInfoList(QDir::Files, QDir::Time | QDir::Reversed);
+    const QDateTime cutoff = QDateTime::currentDateTime().addSecs(-maxAge);
+    qint64 total = 0;
+    for (const QFileInfo &info : files) {
+        total += info.size();
+    }
+    for (const QFileInfo &info : files) {
+        if (active.contains(info.fileName())) continue;
+        if ((info.lastModified() < cutoff || total > maxBytes) && QFile::remove(info.filePath())) {
+            total -= info.size();
+        }
+    }
+    return total;
+}
@@ -0,0 +1,39 @@
+#ifndef BLOBSTORE_H
+#define BLOBSTORE_H
+
+#include <QString>
+#include <QSet>
+
+// Хранилище вложений с адресацией по содержимому: файл лежит под своим
+// SHA-256 (blobs/ab/abcdef...), поэтому одинаковые вложения хранятся один раз.
+// Недокачанные загрузки лежат в partial/ и продолжаются с конца уже записанного.
+class BlobStore
+{
+public:
+    static constexpr qint64 maxBlobSize = Q_INT64_C(2) << 30; // 2 ГиБ
+
+    bool open(const QString &directory);
+    bool isOpen() const { return !rootPath.isEmpty(); }
+
+    static bool isValidHash(const QString &hash); // 64 строчные шестнадцатеричные цифры
+
+    bool contains(const QString &hash) const;
+    qint64 size(const QString &hash) const; // -1, если такого файла нет
+    QString path(const QString &hash) const;
+    QString partialPath(const QString &hash) const;
+    qint64 partialSize(const QString &hash) const;
+
+    // Сверяет хеш недокачанного файла и переносит его на место.
+    // Читает файл целиком, поэтому вызывается из пула потоков.
+    bool commit(const QString &hash) const;
+
+    // Удаляет из partial/ брошенные загрузки: старше maxAge секунд, а если
+    // остальные вместе больше maxBytes — ещё и самые старые. Файлы из active
+    // (идущие загрузки) не трогает. Возвращает, сколько байт осталось.
+    qint64 sweepPartials(qint64 maxAge, qint64 maxBytes, const QSet<QString> &active) const;
+
+private:
+    QString rootPath;
+};
+
+#endif // BLOBSTORE_H
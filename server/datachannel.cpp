@@ -0,0 +1,309 @@
+#include "datachannel.h"
+#include <QPointer>
+#include <QRandomGenerator>
+#include <QThreadPool>
+
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#include <cerrno>
+#endif
+
+DataChannel::DataChannel(BlobStore *store, QObject *parent)
+    : QTcpServer(parent)
+    , store(store)
+{
+    sweepTimer.setInterval(sweepInterval);
+    connect(&sweepTimer, &QTimer::timeout, this, &DataChannel::sweepPartials);
+    sweepTimer.start();
+}
+
+void DataChannel::sweepPartials()
+{
+    // Заодно пересчитывает partialBytes, если учёт разошёлся с диском
+    qint64 reserved = 0;
+    for (const Transfer &transfer : qAsConst(transfers)) {
+        if (transfer.mode == Transfer::Upload) reserved += transfer.end - transfer.offset;
+    }
+    partialBytes = store->sweepPartials(partialLifetime, qMax<qint64>(0, maxPartialBytes - reserved), uploading) + reserved;
+}
+
+QString DataChannel::issueToken(const QString &username)
+{
+    quint32 words[4];
+    QRandomGenerator::system()->fillRange(words);
+    QString token = QString::fromLatin1(QByteArray(reinterpret_cast<const char *>(words), sizeof(words)).toHex());
+    tokens.insert(token, username);
+    return token;
+}
+
+void DataChannel::revokeToken(const QString &token)
+{
+    // Уже начатые передачи доживают до конца, новых по этому токену не будет
+    tokens.remove(token);
+}
+
+void DataChannel::incomingConnection(qintptr socketDescriptor)
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        delete socket;
+        return;
+    }
+
+    socket->setReadBufferSize(readBufferSize);
+    connect(socket, &QTcpSocket::readyRead, this, &DataChannel::onReadyRead);
+    connect(socket, &QTcpSocket::bytesWritten, this, &DataChannel::onBytesWritten);
+    connect(socket, &QTcpSocket::disconnected, this, &DataChannel::onDisconnected);
+    transfers.insert(socket, Transfer());
+}
+
+void DataChannel::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    auto it = transfers.find(socket);
+    if (it == transfers.end()) return;
+
+    if (it->mode == Transfer::Request) {
+        if (!socket->canReadLine()) {
+            if (socket->bytesAvailable() > maxHeaderLength) fail(socket, "Request too long");
+            return;
+        }
+        it->header = socket->readLine(maxHeaderLength + 1).trimmed();
+        startRequest(socket, it.value());
+
+        it = transfers.find(socket); // Соединение могло уже закрыться
+        if (it == transfers.end()) return;
+    }
+
+    // Данные загрузки могли прийти в той же порции, что и заголовок
+    if (it->mode == Transfer::Upload) receiveUpload(socket, it.value());
+}
+
+void DataChannel::onBytesWritten()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    auto it = transfers.find(socket);
+    if (it != transfers.end() && it->mode == Transfer::Download) pumpDownload(socket);
+}
+
+void DataChannel::onDisconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket) return;
+
+    auto it = transfers.find(socket);
+    if (it != transfers.end()) {
+        // Недокачанное остаётся в partial/, следующий PUT продолжит с этого места
+        if (it->mode == Transfer::Upload) {
+            uploading.remove(it->hash);
+            partialBytes -= it->end - it->offset; // Обещанное, но не полученное
+            if (it->offset == 0) it->file->remove(); // Пустой файл продолжать нечего
+        }
+        delete it->file;
+        transfers.erase(it);
+    }
+    socket->deleteLater();
+}
+
+void DataChannel::startRequest(QTcpSocket *socket, Transfer &transfer)
+{
+    QList<QByteArray> parts = transfer.header.split(' ');
+    if (parts.size() != 4) {
+        fail(socket, "Invalid request");
+        return;
+    }
+    if (!tokens.contains(QString::fromLatin1(parts[1]))) {
+        fail(socket, "Invalid token");
+        return;
+    }
+
+    transfer.hash = QString::fromLatin1(parts[2]);
+    bool isNumber = false;
+    qint64 number = parts[3].toLongLong(&isNumber);
+    if (!BlobStore::isValidHash(transfer.hash) || !isNumber || number < 0) {
+        fail(socket, "Invalid request");
+        return;
+    }
+
+    if (parts[0] == "PUT") {
+        startUpload(socket, transfer, number);
+    } else if (parts[0] == "GET") {
+        startDownload(socket, transfer, number);
+    } else {
+        fail(socket, "Invalid request");
+    }
+}
+
+void DataChannel::startUpload(QTcpSocket *socket, Transfer &transfer, qint64 size)
+{
+    if (size > BlobStore::maxBlobSize) {
+        fail(socket, "File too large");
+        return;
+    }
+    if (store->contains(transfer.hash)) {
+        // Такой файл уже есть, загружать нечего
+        socket->write(QString("OFFSET %1\nSTORED %2\n").arg(size).arg(transfer.hash).toLatin1());
+        socket->disconnectFromHost();
+        return;
+    }
+    if (uploading.contains(transfer.hash)) {
+        fail(socket, "Upload in progress");
+        return;
+    }
+
+    // Уже записанное в partial/ учтено, место резервируется под остаток
+    qint64 existing = store->partialSize(transfer.hash);
+    qint64 needed = size - (existing > size ? 0 : existing);
+    if (partialBytes + needed > maxPartialBytes) sweepPartials();
+    if (partialBytes + needed > maxPartialBytes) {
+        fail(socket, "Upload quota exceeded");
+        return;
+    }
+
+    transfer.file = new QFile(store->partialPath(transfer.hash));
+    if (!transfer.file->open(QIODevice::WriteOnly | QIODevice::Append)) {
+        fail(socket, "Cannot store file");
+        return;
+    }
+    transfer.offset = transfer.file->size();
+    if (transfer.offset > size) {
+        transfer.file->resize(0); // Хвост от другого размера, начинаем сначала
+        partialBytes -= transfer.offset;
+        transfer.offset = 0;
+    }
+    transfer.end = size;
+    partialBytes += transfer.end - transfer.offset;
+    transfer.mode = Transfer::Upload;
+    uploading.insert(transfer.hash);
+
+    socket->write(QString("OFFSET %1\n").arg(transfer.offset).toLatin1());
+    if (transfer.offset == transfer.end) verifyUpload(socket, transfer);
+}
+
+void DataChannel::receiveUpload(QTcpSocket *socket, Transfer &transfer)
+{
+    while (transfer.offset < transfer.end && socket->bytesAvailable() > 0) {
+        QByteArray chunk = socket->read(qMin(socket->bytesAvailable(), transfer.end - transfer.offset));
+        if (transfer.file->write(chunk) != chunk.size()) {
+            fail(socket, "Cannot store file");
+            return;
+        }
+        transfer.offset += chunk.size();
+    }
+    if (transfer.offset == transfer.end) verifyUpload(socket, transfer);
+}
+
+void DataChannel::verifyUpload(QTcpSocket *socket, Transfer &transfer)
+{
+    delete transfer.file; // Закрытие сбрасывает буфер на диск
+    transfer.file = nullptr;
+    transfer.mode = Transfer::Verifying;
+
+    // Хеш считается по всему файлу, это не должно тормозить цикл событий
+    QPointer<QTcpSocket> guard(socket);
+    BlobStore *store = this->store;
+    QString hash = transfer.hash;
+    qint64 size = transfer.end;
+    QThreadPool::globalInstance()->start([this, store, guard, hash, size]() {
+        bool stored = store->commit(hash);
+        QMetaObject::invokeMethod(this, [this, guard, hash, size, stored]() {
+            finishUpload(guard.data(), hash, size, stored);
+        });
+    });
+}
+
+void DataChannel::finishUpload(QTcpSocket *socket, const QString &hash, qint64 size, bool stored)
+{
+    uploading.remove(hash);
+    partialBytes -= size; // Файл перенесён на место или удалён как испорченный
+    if (!socket || !transfers.contains(socket)) return;
+
+    socket->write(stored ? ("STORED " + hash + "\n").toLatin1() : QByteArray("ERROR Hash mismatch\n"));
+    socket->disconnectFromHost();
+}
+
+void DataChannel::startDownload(QTcpSocket *socket, Transfer &transfer, qint64 offset)
+{
+    qint64 size = store->size(transfer.hash);
+    if (size < 0) {
+        fail(socket, "No such file");
+        return;
+    }
+    if (offset > size) {
+        fail(socket, "Invalid offset");
+        return;
+    }
+
+    transfer.file = new QFile(store->path(transfer.hash));
+    if (!transfer.file->open(QIODevice::ReadOnly)) {
+        fail(socket, "Cannot read file");
+        return;
+    }
+    transfer.offset = offset;
+    transfer.end = size;
+    transfer.mode = Transfer::Download;
+
+#ifdef Q_OS_LINUX
+    // sendfile пишет мимо буфера QTcpSocket, и bytesWritten после него не придёт.
+    // Второй QSocketNotifier на дескриптор, который уже слушает сам QTcpSocket,
+    // Qt не поддерживает, поэтому следующий заход — по таймеру
+    transfer.resume = new QTimer(socket);
+    transfer.resume->setSingleShot(true);
+    connect(transfer.resume, &QTimer::timeout, this, [this, socket]() {
+        if (transfers.contains(socket)) pumpDownload(socket);
+    });
+#endif
+
+    socket->write(QString("SIZE %1\n").arg(size).toLatin1());
+    socket->flush();
+    pumpDownload(socket);
+}
+
+void DataChannel::pumpDownload(QTcpSocket *socket)
+{
+    Transfer &transfer = transfers[socket];
+
+#ifdef Q_OS_LINUX
+    if (socket->bytesToWrite() > 0) return; // Сначала должен уйти заголовок, дальше позовёт bytesWritten
+
+    // Ограничение на заход: пока идёт файл, остальные соединения тоже обслуживаются
+    qint64 budget = sendBudget;
+    while (transfer.offset < transfer.end && budget > 0) {
+        off_t offset = transfer.offset;
+        ssize_t sent = ::sendfile(int(socket->socketDescriptor()), transfer.file->handle(), &offset,
+                                  size_t(qMin(transfer.end - transfer.offset, budget)));
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (sent <= 0) {
+            socket->abort(); // Ошибка сокета или файл стал короче
+            return;
+        }
+        transfer.offset += sent;
+        budget -= sent;
+    }
+    if (transfer.offset < transfer.end) {
+        // Исчерпан заход — продолжим сразу после других событий, полон буфер — чуть позже
+        transfer.resume->start(budget > 0 ? sendRetryDelay : 0);
+        return;
+    }
+#else
+    while (transfer.offset < transfer.end && socket->bytesToWrite() < readBufferSize) {
+        QByteArray chunk = transfer.file->read(qMin<qint64>(64 * 1024, transfer.end - transfer.offset));
+        if (chunk.isEmpty()) {
+            socket->abort();
+            return;
+        }
+        socket->write(chunk);
+        transfer.offset += chunk.size();
+    }
+    if (transfer.offset < transfer.end) return;
+#endif
+
+    socket->disconnectFromHost(); // Всё отдано, ядро допишет остаток буфера само
+}
+
+void DataChannel::fail(QTcpSocket *socket, const QByteArray &reason)
+{
+    socket->write("ERROR " + reason + "\n");
+    socket->disconnectFromHost();
+}
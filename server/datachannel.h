@@ -0,0 +1,83 @@
+#ifndef DATACHANNEL_H
+#define DATACHANNEL_H
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QFile>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+#include "blobstore.h"
+
+// Отдельный порт для файлов, чтобы большие передачи не задерживали строки
+// чата в основном соединении. Одно соединение — одна передача:
+//   PUT <токен> <sha256> <размер>  ->  OFFSET <n>, затем байты с n до конца, в ответ STORED <sha256>
+//   GET <токен> <sha256> <смещение>  ->  SIZE <размер>, затем байты со смещения до конца
+// Токен выдаёт основное соединение по команде DATA после входа.
+// На Linux файл отдаётся через sendfile без копирования в память процесса.
+//
+// Недокачанные загрузки в partial/ занимают место, пока их не продолжат:
+// новая загрузка принимается, только если вместе с ними и с остатками идущих
+// укладывается в maxPartialBytes, а брошенные старше partialLifetime
+// удаляются раз в sweepInterval.
+class DataChannel : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    DataChannel(BlobStore *store, QObject *parent = nullptr);
+
+    QString issueToken(const QString &username);
+    void revokeToken(const QString &token);
+    int tokenCount() const { return tokens.size(); }
+    int transferCount() const { return transfers.size(); }
+    void sweepPartials(); // При запуске и дальше по таймеру
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private slots:
+    void onReadyRead();
+    void onBytesWritten();
+    void onDisconnected();
+
+private:
+    static constexpr int maxHeaderLength = 256;
+    static constexpr qint64 readBufferSize = 256 * 1024; // Дальше читать не будем, сработает окно TCP
+    static constexpr qint64 sendBudget = 1024 * 1024; // Байт за один заход в цикл событий
+    static constexpr int sendRetryDelay = 5; // мс до новой попытки sendfile, если буфер сокета полон
+    static constexpr qint64 maxPartialBytes = Q_INT64_C(8) << 30; // 8 ГиБ на все недокачанные загрузки
+    static constexpr qint64 partialLifetime = 24 * 3600; // с без докачки, после которых загрузка брошена
+    static constexpr int sweepInterval = 10 * 60 * 1000; // мс
+
+    struct Transfer
+    {
+        enum Mode { Request, Upload, Verifying, Download };
+
+        Mode mode = Request;
+        QByteArray header;
+        QString hash;
+        QFile *file = nullptr;
+        qint64 offset = 0;
+        qint64 end = 0;
+        QTimer *resume = nullptr; // Только для sendfile: следующий заход
+    };
+
+    BlobStore *store;
+    QHash<QTcpSocket*, Transfer> transfers;
+    QHash<QString, QString> tokens; // Токен -> имя пользователя
+    QSet<QString> uploading; // Хеши, которые сейчас кто-то загружает
+    qint64 partialBytes = 0; // Лежит в partial/ плюс ещё не полученное идущими загрузками
+    QTimer sweepTimer;
+
+    void startRequest(QTcpSocket *socket, Transfer &transfer);
+    void startUpload(QTcpSocket *socket, Transfer &transfer, qint64 size);
+    void startDownload(QTcpSocket *socket, Transfer &transfer, qint64 offset);
+    void receiveUpload(QTcpSocket *socket, Transfer &transfer);
+    void verifyUpload(QTcpSocket *socket, Transfer &transfer);
+    void finishUpload(QTcpSocket *socket, const QString &hash, qint64 size, bool stored);
+    void pumpDownload(QTcpSocket *socket);
+    void fail(QTcpSocket *socket, const QByteArray &reason);
+};
+
+#endif // DATACHANNEL_H
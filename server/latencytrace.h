@@ -0,0 +1,280 @@
+#ifndef LATENCYTRACE_H
+#define LATENCYTRACE_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QMutex>
+#include <QRandomGenerator>
+#include <QSaveFile>
+#include <QThread>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+// Выборочная трассировка задержки сообщений, общая для server и client.
+//
+// Трассируемое сообщение несёт в кадре id трассы: префикс "@t=<hex> " перед
+// командой. Каждая стадия обработки записывает отрезок — имя, id трассы,
+// начало и конец по монотонным часам — в буфер своего потока, без общей
+// блокировки. Буфер — кольцо, старые отрезки затираются.
+//
+// toJson() собирает буферы в формат Chrome trace (Perfetto, chrome://tracing).
+// Время в нём — микросекунды от эпохи, поэтому файлы клиента и сервера можно
+// склеить в один, а отрезки одной трассы связаны стрелками через bind_id.
+//
+// Пока трассировка выключена, запись стоит одной relaxed-загрузки флага.
+namespace LatencyTrace {
+
+struct Span
+{
+    const char *name; // Должна жить до конца процесса: литерал или имя стадии
+    quint64 traceId;
+    qint64 startNs;
+    qint64 endNs;
+};
+
+struct ThreadBuffer
+{
+    QMutex mutex; // Пишет только свой поток, конкурирует лишь с toJson()
+    std::vector<Span> spans;
+    size_t next = 0; // Куда писать, когда кольцо заполнено
+    int index = 0; // tid в файле трассы
+    QByteArray name;
+    bool retired = false; // Поток завершился; под защитой Registry::mutex
+};
+
+const size_t bufferCapacity = 65536; // Отрезков на поток
+const int maxRetiredBuffers = 16; // Сверх этого буферы завершившихся потоков отдаются новым, не дожидаясь выгрузки
+
+// Пулы потоков (QThreadPool) меняют простаивающие потоки на новые, поэтому
+// буфер завершившегося потока не освобождается, а ждёт следующей выгрузки
+// (toJson) и затем достаётся новому потоку
+struct Registry
+{
+    QMutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+inline QAtomicInt enabledFlag;
+inline QAtomicInt sampleEvery; // Каждое N-е непомеченное сообщение получает свою трассу; 0 — только помеченные
+
+inline Registry &registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+inline bool isEnabled()
+{
+    return enabledFlag.loadRelaxed() != 0;
+}
+
+inline void setEnabled(bool enabled, int every = 0)
+{
+    sampleEvery.storeRelaxed(qMax(0, every));
+    enabledFlag.storeRelaxed(enabled ? 1 : 0);
+}
+
+inline int sampleRate()
+{
+    return sampleEvery.loadRelaxed();
+}
+
+inline qint64 now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline quint64 newTraceId()
+{
+    quint64 id = 0;
+    while (id == 0) id = QRandomGenerator::global()->generate64();
+    return id;
+}
+
+// id новой трассы с вероятностью 1/N или 0
+inline quint64 sample()
+{
+    if (!isEnabled()) return 0;
+    int every = sampleEvery.loadRelaxed();
+    if (every <= 0 || QRandomGenerator::global()->bounded(every) != 0) return 0;
+    return newTraceId();
+}
+
+inline QByteArray framePrefix(quint64 traceId)
+{
+    return "@t=" + QByteArray::number(traceId, 16) + ' ';
+}
+
+// Снимает префикс трассы с кадра; 0, если его не было
+inline quint64 takeFramePrefix(QByteArray &frame)
+{
+    if (!frame.startsWith("@t=")) return 0;
+    int space = frame.indexOf(' ');
+    if (space < 0) space = frame.size();
+    bool ok = false;
+    quint64 id = frame.mid(3, space - 3).toULongLong(&ok, 16);
+    frame.remove(0, qMin(space + 1, frame.size()));
+    return ok ? id : 0;
+}
+
+// Свободный буфер завершившегося потока: уже выгруженный, а если таких нет и
+// завершившихся слишком много — самый старый из них, вместе с отрезками
+inline ThreadBuffer *reuseBuffer(Registry &shared)
+{
+    ThreadBuffer *oldest = nullptr;
+    int retired = 0;
+    for (const auto &buffer : shared.buffers) {
+        if (!buffer->retired) continue;
+        QMutexLocker bufferLocker(&buffer->mutex);
+        if (buffer->spans.empty()) return buffer.get();
+        if (!oldest) oldest = buffer.get();
+        ++retired;
+    }
+    if (retired < maxRetiredBuffers) return nullptr;
+    QMutexLocker bufferLocker(&oldest->mutex);
+    oldest->spans.clear();
+    oldest->next = 0;
+    return oldest;
+}
+
+struct ThreadBufferOwner
+{
+    ThreadBuffer *buffer = nullptr;
+    ~ThreadBufferOwner()
+    {
+        if (!buffer) return;
+        QMutexLocker locker(&registry().mutex);
+        buffer->retired = true;
+    }
+};
+
+inline ThreadBuffer *threadBuffer()
+{
+    thread_local ThreadBufferOwner owner;
+    if (!owner.buffer) {
+        QThread *thread = QThread::currentThread();
+        QCoreApplication *application = QCoreApplication::instance();
+        QByteArray name = application && thread == application->thread() ? QByteArray("main") : thread->objectName().toUtf8();
+
+        Registry &shared = registry();
+        QMutexLocker locker(&shared.mutex);
+        ThreadBuffer *buffer = reuseBuffer(shared);
+        if (!buffer) {
+            shared.buffers.push_back(std::make_unique<ThreadBuffer>());
+            buffer = shared.buffers.back().get();
+            buffer->index = int(shared.buffers.size());
+        }
+        buffer->retired = false;
+        buffer->name = name.isEmpty() ? "thread " + QByteArray::number(buffer->index) : name;
+        owner.buffer = buffer;
+    }
+    return owner.buffer;
+}
+
+inline void record(const char *name, quint64 traceId, qint64 startNs, qint64 endNs)
+{
+    if (!traceId || !isEnabled()) return;
+
+    ThreadBuffer *buffer = threadBuffer();
+    QMutexLocker locker(&buffer->mutex);
+    if (buffer->spans.size() < bufferCapacity) {
+        buffer->spans.push_back(Span{name, traceId, startNs, endNs});
+    } else {
+        buffer->spans[buffer->next] = Span{name, traceId, startNs, endNs};
+        buffer->next = (buffer->next + 1) % bufferCapacity;
+    }
+}
+
+// Отрезок на время жизни объекта
+class ScopedSpan
+{
+public:
+    ScopedSpan(const char *name, quint64 traceId)
+        : name(name)
+        , traceId(traceId && isEnabled() ? traceId : 0)
+        , startNs(this->traceId ? now() : 0)
+    {
+    }
+    ~ScopedSpan()
+    {
+        if (traceId) record(name, traceId, startNs, now());
+    }
+    ScopedSpan(const ScopedSpan &) = delete;
+    ScopedSpan &operator=(const ScopedSpan &) = delete;
+
+private:
+    const char *name;
+    quint64 traceId;
+    qint64 startNs;
+};
+
+inline QByteArray jsonMicroseconds(qint64 ns)
+{
+    if (ns < 0) return "-" + jsonMicroseconds(-ns);
+    return QByteArray::number(ns / 1000) + '.' + QByteArray::number(ns % 1000).rightJustified(3, '0');
+}
+
+inline QByteArray jsonString(const QByteArray &text)
+{
+    QByteArray escaped = text;
+    escaped.replace('\\', "\\\\").replace('"', "\\\"");
+    return '"' + escaped + '"';
+}
+
+inline QByteArray toJson(const QByteArray &processName)
+{
+    // Монотонные часы у процессов свои, поэтому переводим в системное время
+    qint64 epochOffset = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::system_clock::now().time_since_epoch()).count() - now();
+    QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+
+    QByteArray out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"args\":{\"name\":" + jsonString(processName) + "}}";
+
+    Registry &shared = registry();
+    QMutexLocker locker(&shared.mutex);
+    for (const auto &buffer : shared.buffers) {
+        std::vector<Span> spans;
+        {
+            QMutexLocker bufferLocker(&buffer->mutex);
+            spans = buffer->spans;
+            if (buffer->retired) {
+                // Поток завершился, отрезки выгружены: буфер достанется следующему новому потоку
+                buffer->spans.clear();
+                buffer->next = 0;
+            }
+        }
+        if (spans.empty()) continue;
+
+        QByteArray tid = QByteArray::number(buffer->index);
+        out += ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + tid
+               + ",\"args\":{\"name\":" + jsonString(buffer->name) + "}}";
+        for (const Span &span : spans) {
+            QByteArray id = "\"0x" + QByteArray::number(span.traceId, 16) + '"';
+            out += ",\n{\"name\":" + jsonString(span.name) + ",\"cat\":\"message\",\"ph\":\"X\",\"pid\":" + pid
+                   + ",\"tid\":" + tid + ",\"ts\":" + jsonMicroseconds(span.startNs + epochOffset)
+                   + ",\"dur\":" + jsonMicroseconds(span.endNs - span.startNs)
+                   + ",\"bind_id\":" + id + ",\"flow_in\":true,\"flow_out\":true,\"args\":{\"trace\":" + id + "}}";
+        }
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+inline bool dump(const QString &path, const QByteArray &processName)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    QByteArray json = toJson(processName);
+    if (file.write(json) != json.size()) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+} // namespace LatencyTrace
+
+#endif // LATENCYTRACE_H
@@ -1,15 +1,104 @@
 #include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QtMath>
 #include "server.h"
 
+#ifdef Q_OS_UNIX
+#include <QSocketNotifier>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int signalSockets[2] = { -1, -1 };
+
+// В обработчике сигнала нельзя трогать Qt: только будим цикл событий
+static void onSignal(int signal)
+{
+    char byte = char(signal);
+    ssize_t written = ::write(signalSockets[0], &byte, 1);
+    Q_UNUSED(written);
+}
+
+// SIGUSR1 — сохранить трассу задержки в рабочий каталог.
+// SIGINT и SIGTERM — штатно выйти из цикла событий, чтобы деструктор Server
+// дописал буфер захвата (--capture) на диск.
+static void installSignals(Server *server)
+{
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, signalSockets) != 0) return;
+
+    QSocketNotifier *notifier = new QSocketNotifier(signalSockets[1], QSocketNotifier::Read, server);
+    QObject::connect(notifier, &QSocketNotifier::activated, server, [server]() {
+        char byte;
+        ssize_t got = ::read(signalSockets[1], &byte, 1);
+        if (got != 1) return;
+        if (byte == SIGUSR1) server->dumpTrace();
+        else QCoreApplication::quit();
+    });
+
+    struct sigaction action = {};
+    action.sa_handler = onSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+}
+#endif
+
 int main(int argc, char *argv[])
 {
     QCoreApplication a(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption captureOption("capture", "Write every inbound frame to a trace file for replay.", "file");
+    parser.addOption(captureOption);
+    QCommandLineOption certOption("tls-cert", "PEM certificate chain for the TLS listener.", "file");
+    QCommandLineOption keyOption("tls-key", "PEM private key for the TLS listener.", "file");
+    QCommandLineOption tlsPortOption("tls-port", "Port of the TLS listener (default 1236).", "port", "1236");
+    QCommandLineOption tlsOnlyOption("tls-only", "Do not accept plaintext connections on port 1234.");
+    parser.addOptions({certOption, keyOption, tlsPortOption, tlsOnlyOption});
+    QCommandLineOption floodOption("flood-limit", "Limit each sender to RATE messages per second in bursts of up to BURST (off by default).",
+                                   "rate/burst");
+    parser.addOption(floodOption);
+    QCommandLineOption traceOption("trace-sample", "Record latency spans for every N-th message; dump with TRACE DUMP or SIGUSR1.", "N");
+    parser.addOption(traceOption);
+    parser.process(a);
+
+    bool tls = parser.isSet(certOption) && parser.isSet(keyOption);
+    if (parser.isSet(tlsOnlyOption) && !tls) {
+        qDebug() << "--tls-only needs --tls-cert and --tls-key";
+        return 1;
+    }
+
     Server server;
-    if (!server.startServer()) {
+    if (parser.isSet(captureOption) && !server.startCapture(parser.value(captureOption))) {
+        qDebug() << "Cannot open capture file" << parser.value(captureOption);
+        return 1;
+    }
+    if (parser.isSet(floodOption)) {
+        QStringList limit = parser.value(floodOption).split('/');
+        double rate = limit.value(0).toDouble();
+        int burst = limit.size() > 1 ? limit[1].toInt() : qCeil(rate);
+        if (rate <= 0 || burst <= 0) {
+            qDebug() << "--flood-limit expects RATE/BURST, for example 5/20";
+            return 1;
+        }
+        server.setFloodLimit(rate, burst);
+    }
+    if (parser.isSet(traceOption)) server.startTracing(parser.value(traceOption).toInt());
+#ifdef Q_OS_UNIX
+    installSignals(&server);
+#endif
+    if (!server.startServer(!parser.isSet(tlsOnlyOption))) {
         qDebug() << "Server failed to start!";
         return 1;
     }
+    if (tls && !server.startTls(parser.value(certOption), parser.value(keyOption),
+                                quint16(parser.value(tlsPortOption).toUInt()))) {
+        qDebug() << "Cannot start the TLS listener";
+        return 1;
+    }
 
     qDebug() << "Server started successfully.";
 
@@ -0,0 +1,71 @@
+#include "messagefilters.h"
+#include "searchindex.h"
+#include <QtMath>
+
+FloodFilter::FloodFilter(double rate, int burst)
+    : rate(rate)
+    , burst(burst)
+{
+    clock.start();
+}
+
+bool FloodFilter::check(const QString &sender, const QString &recipient, const QString &text, QString &reason)
+{
+    Q_UNUSED(recipient);
+    Q_UNUSED(text);
+
+    qint64 now = clock.elapsed();
+    QMutexLocker locker(&mutex);
+
+    auto it = buckets.find(sender);
+    if (it == buckets.end()) {
+        it = buckets.insert(sender, Bucket{double(burst), now});
+    } else {
+        it->tokens = qMin<double>(burst, it->tokens + (now - it->updated) * rate / 1000.0);
+        it->updated = now;
+    }
+
+    if (it->tokens < 1.0) {
+        reason = "Too many messages, slow down";
+        return false;
+    }
+    it->tokens -= 1.0;
+
+    // Полные корзины ничего не ограничивают, их можно забыть. Порог растёт
+    // вместе с числом живых корзин, так что обход в среднем стоит O(1) на сообщение
+    if (buckets.size() >= sweepThreshold) {
+        for (auto bucket = buckets.begin(); bucket != buckets.end();) {
+            if (bucket->tokens + (now - bucket->updated) * rate / 1000.0 >= burst) {
+                bucket = buckets.erase(bucket);
+            } else {
+                ++bucket;
+            }
+        }
+        sweepThreshold = qMax(10000, buckets.size() * 2);
+    }
+    return true;
+}
+
+int FloodFilter::retryDelay() const
+{
+    return qCeil(1000.0 / rate); // Столько копится один токен
+}
+
+BannedWordsFilter::BannedWordsFilter(const QSet<QString> &words)
+    : words(words)
+{
+}
+
+bool BannedWordsFilter::check(const QString &sender, const QString &recipient, const QString &text, QString &reason)
+{
+    Q_UNUSED(sender);
+    Q_UNUSED(recipient);
+
+    for (const QString &word : SearchIndex::tokenize(text)) {
+        if (words.contains(word)) {
+            reason = "Message contains a banned word";
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef MESSAGEFILTERS_H
+#define MESSAGEFILTERS_H
+
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QElapsedTimer>
+#include "messagepipeline.h"
+
+// Ограничение частоты сообщений от одного отправителя (корзина токенов):
+// в среднем не больше rate сообщений в секунду, всплеском до burst.
+// Отказ временный: через retryDelay() в корзине появится место.
+class FloodFilter : public MessageFilter
+{
+public:
+    FloodFilter(double rate, int burst);
+
+    QString name() const override { return "flood"; }
+    bool check(const QString &sender, const QString &recipient, const QString &text, QString &reason) override;
+    int retryDelay() const override;
+
+private:
+    struct Bucket
+    {
+        double tokens = 0;
+        qint64 updated = 0; // мс от старта фильтра
+    };
+
+    double rate;
+    int burst;
+    QElapsedTimer clock;
+    QMutex mutex; // Корзины общие для всех потоков пула
+    QHash<QString, Bucket> buckets;
+    int sweepThreshold = 10000; // Чистка, когда корзин стало вдвое больше, чем осталось после прошлой
+};
+
+// Отклоняет сообщения, в которых есть слово из списка.
+// Слова сравниваются после той же нормализации, что и в поиске.
+class BannedWordsFilter : public MessageFilter
+{
+public:
+    explicit BannedWordsFilter(const QSet<QString> &words);
+
+    QString name() const override { return "banned_words"; }
+    bool check(const QString &sender, const QString &recipient, const QString &text, QString &reason) override;
+
+private:
+    const QSet<QString> words; // Не меняется после создания, блокировки не нужны
+};
+
+#endif // MESSAGEFILTERS_H
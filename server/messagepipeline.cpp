@@ -0,0 +1,171 @@
+#include "messagepipeline.h"
+#include "latencytrace.h"
+
+MessagePipeline::MessagePipeline(QObject *parent)
+    : QObject(parent)
+{
+    checked.name = "pipeline";
+}
+
+MessagePipeline::~MessagePipeline()
+{
+    pool.waitForDone(); // Задачи обращаются к фильтрам
+    qDeleteAll(stages);
+}
+
+void MessagePipeline::addFilter(MessageFilter *filter)
+{
+    Stage *stage = new Stage;
+    stage->filter.reset(filter);
+    stage->traceName = "filter." + filter->name().toUtf8();
+    stages.append(stage);
+}
+
+void MessagePipeline::setTrustedSenders(const QSet<QString> &senders)
+{
+    trustedSenders = senders;
+}
+
+void MessagePipeline::submit(PipelineMessage message)
+{
+    QString key = conversationKey(message.sender, message.recipient);
+    quint64 position = conversations[key].nextPosition++;
+
+    if (message.traceId) message.submittedNs = LatencyTrace::now();
+
+    // Проверять нечего: выпускаем сразу, если беседа не ждёт более ранних сообщений
+    if (stages.isEmpty() || trustedSenders.contains(message.sender)) {
+        Verdict verdict;
+        verdict.message = message;
+        release(key, position, verdict);
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->id = nextJobId++;
+    job->traceId = message.traceId;
+    job->sender = message.sender;
+    job->recipient = message.recipient;
+    job->text = message.text;
+    job->reasons.resize(size_t(stages.size()));
+    job->remaining.storeRelaxed(stages.size());
+    job->submitted.start();
+
+    Pending pending;
+    pending.message = message;
+    pending.conversation = key;
+    pending.position = position;
+    inFlight.insert(job->id, pending);
+
+    for (int i = 0; i < stages.size(); ++i) {
+        pool.start([this, job, i]() { runStage(job, i); });
+    }
+}
+
+QVector<StageStats> MessagePipeline::stageStats() const
+{
+    QVector<StageStats> result;
+    for (const Stage *stage : stages) {
+        StageStats stats;
+        stats.name = stage->filter->name();
+        stats.calls = stage->calls.loadRelaxed();
+        stats.rejected = stage->rejected.loadRelaxed();
+        stats.totalNs = stage->totalNs.loadRelaxed();
+        stats.maxNs = stage->maxNs.loadRelaxed();
+        result.append(stats);
+    }
+    return result;
+}
+
+StageStats MessagePipeline::totalStats() const
+{
+    return checked;
+}
+
+QString MessagePipeline::conversationKey(const QString &sender, const QString &recipient)
+{
+    if (recipient == "ALL") return recipient;
+    return sender < recipient ? sender + QChar(0x1f) + recipient : recipient + QChar(0x1f) + sender;
+}
+
+void MessagePipeline::updateMax(QAtomicInteger<quint64> &max, quint64 value)
+{
+    quint64 current = max.loadRelaxed();
+    while (value > current && !max.testAndSetRelaxed(current, value, current)) {
+    }
+}
+
+// Выполняется в пуле
+void MessagePipeline::runStage(const std::shared_ptr<Job> &job, int index)
+{
+    Stage *stage = stages[index];
+
+    QElapsedTimer timer;
+    timer.start();
+    QString reason;
+    bool accepted;
+    {
+        LatencyTrace::ScopedSpan span(stage->traceName.constData(), job->traceId);
+        accepted = stage->filter->check(job->sender, job->recipient, job->text, reason);
+    }
+    quint64 elapsed = quint64(timer.nsecsElapsed());
+
+    stage->calls.fetchAndAddRelaxed(1);
+    stage->totalNs.fetchAndAddRelaxed(elapsed);
+    updateMax(stage->maxNs, elapsed);
+    if (!accepted) {
+        stage->rejected.fetchAndAddRelaxed(1);
+        job->reasons[size_t(index)] = reason.isEmpty() ? stage->filter->name() : reason;
+    }
+
+    // Последний закончивший фильтр возвращает сообщение в поток сервера
+    if (job->remaining.fetchAndSubOrdered(1) == 1) {
+        QMetaObject::invokeMethod(this, [this, job]() { complete(job); }, Qt::QueuedConnection);
+    }
+}
+
+void MessagePipeline::complete(const std::shared_ptr<Job> &job)
+{
+    quint64 elapsed = quint64(job->submitted.nsecsElapsed());
+    ++checked.calls;
+    checked.totalNs += elapsed;
+    checked.maxNs = qMax(checked.maxNs, elapsed);
+
+    Pending pending = inFlight.take(job->id);
+    Verdict verdict;
+    verdict.message = pending.message;
+    for (size_t i = 0; i < job->reasons.size(); ++i) {
+        if (!job->reasons[i].isEmpty()) { // Первый отказ по порядку фильтров
+            verdict.accepted = false;
+            verdict.reason = job->reasons[i];
+            verdict.retryAfter = stages[int(i)]->filter->retryDelay();
+            ++checked.rejected;
+            break;
+        }
+    }
+    release(pending.conversation, pending.position, verdict);
+}
+
+void MessagePipeline::release(const QString &key, quint64 position, const Verdict &verdict)
+{
+    Conversation &conversation = conversations[key];
+    conversation.ready.insert(position, verdict);
+
+    QVector<Verdict> released;
+    while (!conversation.ready.isEmpty() && conversation.ready.firstKey() == conversation.nextRelease) {
+        released.append(conversation.ready.take(conversation.nextRelease));
+        ++conversation.nextRelease;
+    }
+    if (conversation.nextRelease == conversation.nextPosition) {
+        conversations.remove(key); // Всё выпущено, не держим запись для каждой пары собеседников
+    }
+
+    // Сигналы после обновления очереди: обработчик может снова вызвать submit
+    for (const Verdict &ready : qAsConst(released)) {
+        // От submit до выпуска: проверки и ожидание более ранних сообщений беседы
+        if (ready.message.traceId) {
+            LatencyTrace::record("pipeline", ready.message.traceId, ready.message.submittedNs, LatencyTrace::now());
+        }
+        emit filtered(ready.message, ready.accepted, ready.reason, ready.retryAfter);
+    }
+}
@@ -0,0 +1,143 @@
+#ifndef MESSAGEPIPELINE_H
+#define MESSAGEPIPELINE_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QPointer>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QVector>
+#include <QAtomicInteger>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <memory>
+#include <vector>
+
+// Проверка входящего сообщения (спам, флуд, запрещённые слова).
+// Вызывается из пула потоков одновременно для разных сообщений,
+// поэтому check() обязан быть потокобезопасным.
+class MessageFilter
+{
+public:
+    virtual ~MessageFilter() = default;
+
+    virtual QString name() const = 0;
+    // false — сообщение отклонено, причина для отправителя в reason
+    virtual bool check(const QString &sender, const QString &recipient, const QString &text, QString &reason) = 0;
+    // Через сколько мс то же сообщение может пройти; 0 — отказ окончательный
+    virtual int retryDelay() const { return 0; }
+};
+
+struct PipelineMessage
+{
+    QPointer<QTcpSocket> client; // Отправитель мог отключиться, пока шла проверка
+    QString sender;
+    QString recipient;
+    QString text;
+    quint64 sequence = 0; // Номер SEND для ACK, 0 для MSG
+    quint64 traceId = 0; // Трасса задержки (latencytrace.h), 0 — не трассируется
+    qint64 submittedNs = 0; // Для отрезка "pipeline", только у трассируемых
+};
+
+struct StageStats
+{
+    QString name;
+    quint64 calls = 0;
+    quint64 rejected = 0;
+    quint64 totalNs = 0;
+    quint64 maxNs = 0;
+};
+
+// Конвейер проверок между приёмом сообщения и доставкой. Все фильтры одного
+// сообщения запускаются в пуле параллельно, так что задержка равна самому
+// медленному из них, а не сумме. Готовые сообщения выпускаются (filtered)
+// в порядке поступления внутри каждой беседы, даже если проверки закончились
+// в другом порядке. Сообщения доверенных отправителей проверки не проходят,
+// но очередь беседы соблюдают. Методы вызываются из потока сервера.
+class MessagePipeline : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MessagePipeline(QObject *parent = nullptr);
+    ~MessagePipeline();
+
+    void addFilter(MessageFilter *filter); // Конвейер становится владельцем; только до первого submit
+    void setTrustedSenders(const QSet<QString> &senders);
+    bool isEmpty() const { return stages.isEmpty(); }
+
+    void submit(PipelineMessage message);
+
+    int pending() const { return inFlight.size(); }
+    int conversationCount() const { return conversations.size(); } // Беседы с невыпущенными сообщениями
+    QVector<StageStats> stageStats() const;
+    StageStats totalStats() const; // От submit до выпуска, по проверенным сообщениям
+
+signals:
+    void filtered(const PipelineMessage &message, bool accepted, const QString &reason, int retryAfter);
+
+private:
+    struct Stage
+    {
+        std::unique_ptr<MessageFilter> filter;
+        QByteArray traceName; // Имя отрезка трассы, живёт вместе со стадией
+        QAtomicInteger<quint64> calls;
+        QAtomicInteger<quint64> rejected;
+        QAtomicInteger<quint64> totalNs;
+        QAtomicInteger<quint64> maxNs;
+    };
+
+    // Общая для задач пула часть: только копии строк, сокетов здесь нет
+    struct Job
+    {
+        quint64 id = 0;
+        quint64 traceId = 0;
+        QString sender;
+        QString recipient;
+        QString text;
+        std::vector<QString> reasons; // По ячейке на фильтр, каждую пишет своя задача
+        QAtomicInt remaining;
+        QElapsedTimer submitted;
+    };
+
+    struct Verdict
+    {
+        PipelineMessage message;
+        bool accepted = true;
+        QString reason;
+        int retryAfter = 0; // мс, если отказавший фильтр временный
+    };
+
+    struct Conversation
+    {
+        quint64 nextPosition = 0; // Номер, который получит следующее сообщение
+        quint64 nextRelease = 0; // Номер, которого ждёт выпуск
+        QMap<quint64, Verdict> ready; // Проверенные, но ждущие более ранних
+    };
+
+    QVector<Stage*> stages;
+    QSet<QString> trustedSenders;
+    QThreadPool pool;
+
+    struct Pending
+    {
+        PipelineMessage message;
+        QString conversation;
+        quint64 position = 0;
+    };
+
+    quint64 nextJobId = 1;
+    QHash<quint64, Pending> inFlight; // Сообщения на проверке, по номеру задачи
+    QHash<QString, Conversation> conversations;
+
+    StageStats checked; // Считается в потоке сервера, в complete()
+
+    static QString conversationKey(const QString &sender, const QString &recipient);
+    static void updateMax(QAtomicInteger<quint64> &max, quint64 value);
+    void runStage(const std::shared_ptr<Job> &job, int index);
+    void complete(const std::shared_ptr<Job> &job);
+    void release(const QString &key, quint64 position, const Verdict &verdict);
+};
+
+#endif // MESSAGEPIPELINE_H
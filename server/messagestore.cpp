@@ -0,0 +1,80 @@
+#include "messagestore.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QtEndian>
+
+bool MessageStore::open(const QString &directory)
+{
+    QDir dir(directory);
+    if (!dir.exists() && !dir.mkpath(".")) return false;
+
+    logFile.setFileName(dir.filePath("messages.log"));
+    indexFile.setFileName(dir.filePath("messages.idx"));
+    if (!logFile.open(QIODevice::ReadWrite) || !indexFile.open(QIODevice::ReadWrite)) {
+        logFile.close();
+        indexFile.close();
+        return false;
+    }
+
+    // Недописанное смещение после аварийного завершения отбрасываем
+    messageCount = quint64(indexFile.size()) / sizeof(quint64);
+    indexFile.resize(qint64(messageCount * sizeof(quint64)));
+    return true;
+}
+
+bool MessageStore::isOpen() const
+{
+    return logFile.isOpen();
+}
+
+quint64 MessageStore::count() const
+{
+    return messageCount;
+}
+
+quint64 MessageStore::append(const QString &sender, const QString &recipient, const QString &text)
+{
+    if (!isOpen()) return 0;
+
+    QByteArray record;
+    QDataStream out(&record, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_15);
+    out << QDateTime::currentMSecsSinceEpoch() << sender.toUtf8() << recipient.toUtf8() << text.toUtf8();
+
+    qint64 offset = logFile.size();
+    logFile.seek(offset);
+    if (logFile.write(record) != record.size()) return 0;
+
+    uchar entry[sizeof(quint64)];
+    qToBigEndian(quint64(offset), entry);
+    indexFile.seek(indexFile.size());
+    if (indexFile.write(reinterpret_cast<const char *>(entry), sizeof(entry)) != sizeof(entry)) return 0;
+
+    logFile.flush();
+    indexFile.flush();
+    return ++messageCount;
+}
+
+bool MessageStore::read(quint64 id, StoredMessage &message)
+{
+    if (!isOpen() || id == 0 || id > messageCount) return false;
+
+    uchar entry[sizeof(quint64)];
+    indexFile.seek(qint64((id - 1) * sizeof(quint64)));
+    if (indexFile.read(reinterpret_cast<char *>(entry), sizeof(entry)) != sizeof(entry)) return false;
+
+    logFile.seek(qint64(qFromBigEndian<quint64>(entry)));
+    QDataStream in(&logFile);
+    in.setVersion(QDataStream::Qt_5_15);
+
+    QByteArray sender, recipient, text;
+    in >> message.timestamp >> sender >> recipient >> text;
+    if (in.status() != QDataStream::Ok) return false;
+
+    message.id = id;
+    message.sender = QString::fromUtf8(sender);
+    message.recipient = QString::fromUtf8(recipient);
+    message.text = QString::fromUtf8(text);
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef MESSAGESTORE_H
+#define MESSAGESTORE_H
+
+#include <QFile>
+#include <QString>
+
+struct StoredMessage
+{
+    quint64 id = 0;
+    qint64 timestamp = 0; // Мс с начала эпохи (UTC)
+    QString sender;
+    QString recipient; // Имя пользователя или "ALL"
+    QString text;
+};
+
+// Журнал сообщений: messages.log хранит записи подряд, messages.idx — смещение
+// каждой записи (8 байт на сообщение), так что чтение по id стоит одного seek.
+// Идентификаторы начинаются с 1, 0 означает "не сохранено".
+class MessageStore
+{
+public:
+    bool open(const QString &directory);
+    bool isOpen() const;
+    quint64 count() const;
+
+    quint64 append(const QString &sender, const QString &recipient, const QString &text);
+    bool read(quint64 id, StoredMessage &message);
+
+private:
+    QFile logFile;
+    QFile indexFile;
+    quint64 messageCount = 0;
+};
+
+#endif // MESSAGESTORE_H
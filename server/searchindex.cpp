@@ -0,0 +1,733 @@
+#include "searchindex.h"
+#include <QDir>
+#include <QPair>
+#include <QSaveFile>
+#include <QSet>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+const quint32 segmentMagic = 0x53435849; // "SCXI"
+const quint32 segmentVersion = 2; // Сегменты версии 1 читались в память целиком, их заменит переиндексация
+const int headerSize = 24; // magic, version, base, docCount, число термов
+const int directoryEntrySize = 20; // Смещение и длина терма, число вхождений, смещение и длина списка
+const int skipEntrySize = 8; // Первое значение блока и смещение его разностей
+const int maxTokenLength = 64;
+const qint64 entryOverhead = 48; // Узел QHash и заголовки строки и списка
+const QChar termMarker(0x01);
+
+void appendLittleEndian32(QByteArray &out, quint32 value)
+{
+    uchar bytes[4];
+    qToLittleEndian(value, bytes);
+    out.append(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+}
+
+void appendLittleEndian64(QByteArray &out, quint64 value)
+{
+    uchar bytes[8];
+    qToLittleEndian(value, bytes);
+    out.append(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+}
+}
+
+// Проход по списку вхождений вперёд: по вектору изменяемого сегмента или по
+// блокам файла. seek() перепрыгивает блоки по таблице пропусков, так что
+// длинный список вроде roomTerm("ALL") не разбирается целиком.
+class SearchIndex::Cursor
+{
+public:
+    Cursor() = default;
+
+    explicit Cursor(const QVector<quint32> *list)
+        : list(list)
+        , total(quint32(list->size()))
+    {
+        if (total) current = list->first();
+    }
+
+    Cursor(const uchar *postings, quint32 length, quint32 count)
+    {
+        quint32 blocks = (count + postingBlockSize - 1) / postingBlockSize;
+        if (quint64(blocks) * skipEntrySize > length) return; // Повреждённый список читается как пустой
+        skips = postings;
+        blockData = postings + quint64(blocks) * skipEntrySize;
+        end = postings + length;
+        blockCount = blocks;
+        total = count;
+        if (total) loadBlock(0);
+    }
+
+    quint32 size() const { return total; }
+    bool atEnd() const { return position >= total; }
+    quint32 value() const { return current; }
+
+    void next()
+    {
+        if (atEnd() || ++position >= total) return;
+        if (list) {
+            current = list->at(int(position));
+        } else if (position % postingBlockSize == 0) {
+            loadBlock(position / postingBlockSize);
+        } else {
+            quint32 delta = 0;
+            for (int shift = 0;; shift += 7) {
+                if (cursor >= end || shift > 28) {
+                    position = total;
+                    return;
+                }
+                uchar byte = *cursor++;
+                delta |= quint32(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) break;
+            }
+            current += delta;
+        }
+    }
+
+    // К первому значению не меньше target, назад не ходит
+    void seek(quint32 target)
+    {
+        if (atEnd() || current >= target) return;
+        if (list) {
+            auto it = std::lower_bound(list->constBegin() + position, list->constEnd(), target);
+            position = quint32(it - list->constBegin());
+            if (!atEnd()) current = *it;
+            return;
+        }
+
+        // Последний блок, который начинается не дальше target
+        quint32 block = position / postingBlockSize;
+        quint32 low = block + 1, high = blockCount;
+        while (low < high) {
+            quint32 middle = low + (high - low) / 2;
+            if (blockFirst(middle) <= target) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        if (low - 1 > block) loadBlock(low - 1);
+        while (!atEnd() && current < target) next();
+    }
+
+private:
+    const QVector<quint32> *list = nullptr;
+    const uchar *skips = nullptr;
+    const uchar *blockData = nullptr;
+    const uchar *end = nullptr;
+    const uchar *cursor = nullptr; // Следующая разность в текущем блоке
+    quint32 blockCount = 0;
+    quint32 total = 0;
+    quint32 position = 0;
+    quint32 current = 0;
+
+    quint32 blockFirst(quint32 block) const
+    {
+        return qFromLittleEndian<quint32>(skips + quint64(block) * skipEntrySize);
+    }
+
+    void loadBlock(quint32 block)
+    {
+        quint32 offset = qFromLittleEndian<quint32>(skips + quint64(block) * skipEntrySize + 4);
+        if (offset > quint64(end - blockData)) {
+            position = total;
+            return;
+        }
+        position = block * postingBlockSize;
+        current = blockFirst(block);
+        cursor = blockData + offset;
+    }
+};
+
+SearchIndex::~SearchIndex()
+{
+    pool.waitForDone(); // Слияние читает отображения сегментов
+}
+
+bool SearchIndex::open(const QString &directory)
+{
+    QDir dir(directory);
+    if (!dir.exists() && !dir.mkpath(".")) return false;
+    this->directory = dir.absolutePath();
+    pool.setMaxThreadCount(1);
+
+    // Имена содержат base с ведущими нулями, поэтому сортировка по имени даёт порядок id.
+    // Читаются только заголовки, остальное подтянется при поиске
+    const QStringList files = dir.entryList(QStringList() << "segment-*.seg", QDir::Files, QDir::Name);
+    for (const QString &fileName : files) {
+        Segment segment;
+        segment.file = std::make_shared<QFile>(dir.filePath(fileName));
+        if (!segment.file->open(QIODevice::ReadOnly) || !mapSegment(segment)) {
+            break; // Всё, что дальше, переиндексируется из журнала
+        }
+        segment.file->close();
+        if (segment.base < activeBase) {
+            // Вход слияния, которое остановилось до удаления входов: его id уже в слитом сегменте
+            segment = Segment();
+            dir.remove(fileName);
+            continue;
+        }
+
+        activeBase = segment.base + segment.docCount;
+        sealed.append(segment);
+    }
+    startMerge();
+    return true;
+}
+
+quint64 SearchIndex::indexedUpTo() const
+{
+    return activeBase + activeCount - 1;
+}
+
+qint64 SearchIndex::memoryUsage() const
+{
+    // Отображённые сегменты — страничный кеш, в куче только изменяемый сегмент
+    return activeHeapBytes + sealedHeapBytes;
+}
+
+void SearchIndex::add(quint64 id, const QString &sender, const QString &recipient, const QString &text)
+{
+    if (id < activeBase + activeCount) return; // Уже проиндексировано
+    finishMerge();
+
+    if (id - activeBase >= segmentSize) {
+        seal();
+        activeBase = id; // Пропущенные id просто не попадают в индекс
+    }
+
+    QSet<QString> terms;
+    for (const QString &token : tokenize(text)) {
+        terms.insert(token);
+    }
+    terms.insert(userTerm(sender));
+    if (recipient == "ALL") {
+        terms.insert(roomTerm(recipient));
+    } else {
+        terms.insert(userTerm(recipient));
+        terms.insert(dmTerm(sender, recipient));
+    }
+
+    quint32 offset = quint32(id - activeBase);
+    for (const QString &term : qAsConst(terms)) {
+        auto it = activePostings.find(term);
+        if (it == activePostings.end()) {
+            it = activePostings.insert(term, QVector<quint32>());
+            activeHeapBytes += entryOverhead + term.size() * 2;
+        }
+        int capacity = it->capacity();
+        it->append(offset);
+        activeHeapBytes += qint64(it->capacity() - capacity) * 4;
+    }
+
+    activeCount = offset + 1;
+    if (activeCount >= segmentSize) seal();
+}
+
+QVector<quint64> SearchIndex::search(const QStringList &terms, const QStringList &visibleTerms, int limit) const
+{
+    QVector<quint64> results;
+    if (terms.isEmpty() || visibleTerms.isEmpty() || limit <= 0) return results;
+
+    QStringList uniqueTerms = terms;
+    uniqueTerms.removeDuplicates();
+
+    auto collect = [&](quint64 base, const QVector<quint32> &matches) {
+        for (int i = matches.size() - 1; i >= 0 && results.size() < limit; --i) {
+            results.append(base + matches[i]);
+        }
+    };
+
+    // Сначала самые свежие сообщения из изменяемого сегмента
+    QVector<Cursor> termCursors, visibleCursors;
+    for (const QString &term : qAsConst(uniqueTerms)) {
+        auto it = activePostings.constFind(term);
+        if (it == activePostings.constEnd()) break;
+        termCursors.append(Cursor(&*it));
+    }
+    if (termCursors.size() == uniqueTerms.size()) {
+        for (const QString &term : visibleTerms) {
+            auto it = activePostings.constFind(term);
+            if (it != activePostings.constEnd()) visibleCursors.append(Cursor(&*it));
+        }
+        collect(activeBase, match(termCursors, visibleCursors));
+    }
+
+    for (int s = sealed.size() - 1; s >= 0 && results.size() < limit; --s) {
+        const Segment &segment = sealed[s];
+
+        termCursors.clear();
+        visibleCursors.clear();
+        for (const QString &term : qAsConst(uniqueTerms)) {
+            Cursor cursor = find(segment, term);
+            if (cursor.size() == 0) break;
+            termCursors.append(cursor);
+        }
+        if (termCursors.size() != uniqueTerms.size()) continue;
+
+        for (const QString &term : visibleTerms) {
+            Cursor cursor = find(segment, term);
+            if (cursor.size() != 0) visibleCursors.append(cursor);
+        }
+        collect(segment.base, match(termCursors, visibleCursors));
+    }
+
+    return results;
+}
+
+QVector<quint64> SearchIndex::postingsAfter(const QString &term, quint64 afterId, int limit) const
+{
+    QVector<quint64> results;
+    if (limit <= 0) return results;
+
+    auto collect = [&](quint64 base, quint32 docCount, Cursor cursor) {
+        if (afterId >= base) {
+            quint64 from = afterId - base + 1;
+            if (from >= docCount) return;
+            cursor.seek(quint32(from));
+        }
+        for (; !cursor.atEnd() && results.size() < limit; cursor.next()) {
+            results.append(base + cursor.value());
+        }
+    };
+
+    // Первый сегмент, в котором могут быть id больше afterId
+    auto segment = std::upper_bound(sealed.constBegin(), sealed.constEnd(), afterId,
+                                    [](quint64 id, const Segment &s) { return id < s.base + s.docCount; });
+    for (; segment != sealed.constEnd() && results.size() < limit; ++segment) {
+        collect(segment->base, segment->docCount, find(*segment, term));
+    }
+
+    auto it = activePostings.constFind(term);
+    if (it != activePostings.constEnd() && results.size() < limit) collect(activeBase, activeCount, Cursor(&*it));
+    return results;
+}
+
+QStringList SearchIndex::tokenize(const QString &text)
+{
+    QStringList tokens;
+    QString current;
+    const QString folded = text.toCaseFolded();
+    for (const QChar ch : folded) {
+        if (ch.isLetterOrNumber()) {
+            current.append(ch);
+        } else if (!current.isEmpty()) {
+            if (current.size() <= maxTokenLength) tokens << current;
+            current.clear();
+        }
+    }
+    if (!current.isEmpty() && current.size() <= maxTokenLength) tokens << current;
+    return tokens;
+}
+
+// Служебные термы начинаются с termMarker и не пересекаются с обычными словами
+QString SearchIndex::userTerm(const QString &username)
+{
+    return QString(termMarker) + QLatin1String("u:") + username;
+}
+
+QString SearchIndex::dmTerm(const QString &first, const QString &second)
+{
+    return first < second ? QString(termMarker) + QLatin1String("d:") + first + QChar(0x1f) + second
+                          : QString(termMarker) + QLatin1String("d:") + second + QChar(0x1f) + first;
+}
+
+QString SearchIndex::roomTerm(const QString &room)
+{
+    return QString(termMarker) + QLatin1String("r:") + room;
+}
+
+void SearchIndex::seal()
+{
+    if (activeCount == 0) return;
+
+    // Записанный сегмент читается через отображение, копия в куче не нужна
+    QByteArray bytes = encodeSegment(activeBase, activeCount, activePostings);
+    Segment segment;
+    if (!directory.isEmpty()) {
+        QSaveFile file(segmentPath(activeBase));
+        if (file.open(QIODevice::WriteOnly) && file.write(bytes) == bytes.size() && file.commit()) {
+            segment.file = std::make_shared<QFile>(segmentPath(activeBase));
+            if (!segment.file->open(QIODevice::ReadOnly) || !mapSegment(segment)) segment = Segment();
+            if (segment.file) segment.file->close();
+        }
+    }
+    if (!segment.data) {
+        // При ошибке записи сегмент восстановится из журнала после перезапуска
+        segment.bytes = bytes;
+        mapSegment(segment);
+    }
+    sealed.append(segment);
+    sealedHeapBytes += segment.bytes.capacity();
+
+    activeBase += activeCount;
+    activeCount = 0;
+    activePostings.clear();
+    activeHeapBytes = 0;
+
+    startMerge();
+}
+
+int SearchIndex::tier(quint32 docCount)
+{
+    quint64 limit = segmentSize;
+    int level = 0;
+    while (docCount > limit) {
+        limit *= mergeFactor;
+        ++level;
+    }
+    return level;
+}
+
+// Первые mergeFactor подряд идущих сегментов одного яруса, записанных в файлы
+void SearchIndex::startMerge()
+{
+    if (merge || directory.isEmpty()) return;
+
+    int first = 0;
+    while (first + mergeFactor <= sealed.size()) {
+        int level = tier(sealed[first].docCount);
+        int last = first;
+        while (last < first + mergeFactor && last < sealed.size() && sealed[last].file
+               && tier(sealed[last].docCount) == level) {
+            ++last;
+        }
+        if (last - first < mergeFactor || level >= maxMergeTier) {
+            first = qMax(first + 1, last);
+            continue;
+        }
+
+        merge = std::make_shared<Merge>();
+        merge->inputs = sealed.mid(first, mergeFactor);
+        merge->path = segmentPath(sealed[first].base);
+        std::shared_ptr<Merge> job = merge;
+        pool.start([job]() {
+            job->ok = writeMerged(job->inputs, job->path);
+            job->done.storeRelease(1);
+        });
+        return;
+    }
+}
+
+void SearchIndex::finishMerge()
+{
+    if (!merge || !merge->done.loadAcquire()) return;
+    std::shared_ptr<Merge> finished = std::move(merge);
+    merge.reset();
+    if (!finished->ok) return; // Входы остались как были; следующая попытка после нового сегмента
+
+    Segment segment;
+    segment.file = std::make_shared<QFile>(finished->path);
+    if (!segment.file->open(QIODevice::ReadOnly) || !mapSegment(segment)) return; // Старые отображения ещё живы
+    segment.file->close();
+
+    // Пока шло слияние, в конец могли добавиться только новые сегменты
+    const QVector<Segment> &inputs = finished->inputs;
+    int first = 0;
+    while (first < sealed.size() && sealed[first].base != inputs.first().base) ++first;
+    if (first + inputs.size() > sealed.size()) return;
+    sealed.remove(first, inputs.size());
+    sealed.insert(first, segment);
+    for (int i = 1; i < inputs.size(); ++i) {
+        QFile::remove(segmentPath(inputs[i].base)); // Отображение переживает удаление файла
+    }
+
+    startMerge();
+}
+
+// Сливает каталоги входов и пишет списки вхождений по одному терму, не
+// собирая сегмент в памяти: сначала считаются термы и размер ключей, чтобы
+// знать, где начнутся списки, затем списки пишутся потоком, а каталог и
+// заголовок дописываются в начало файла в конце
+bool SearchIndex::writeMerged(const QVector<Segment> &inputs, const QString &path)
+{
+    const quint64 base = inputs.first().base;
+    const quint64 docCount = inputs.last().base + inputs.last().docCount - base;
+    if (docCount > std::numeric_limits<quint32>::max()) return false;
+
+    auto entryAt = [](const Segment &segment, quint32 index) {
+        return segment.data + headerSize + quint64(index) * directoryEntrySize;
+    };
+    auto keyAt = [&](const Segment &segment, quint32 index) {
+        const uchar *entry = entryAt(segment, index);
+        quint32 offset = qFromLittleEndian<quint32>(entry);
+        quint32 length = qFromLittleEndian<quint32>(entry + 4);
+        if (quint64(offset) + length > quint64(segment.size)) return QByteArray();
+        return QByteArray::fromRawData(reinterpret_cast<const char *>(segment.data + offset), int(length));
+    };
+
+    // visit(ключ, номера входов с этим термом) по возрастанию ключей; false — вход повреждён
+    auto forEachTerm = [&](const auto &visit) {
+        QVector<quint32> positions(inputs.size(), 0);
+        QVector<int> holders;
+        for (;;) {
+            QByteArray smallest;
+            holders.clear();
+            for (int i = 0; i < inputs.size(); ++i) {
+                if (positions[i] >= inputs[i].termCount) continue;
+                QByteArray key = keyAt(inputs[i], positions[i]);
+                if (key.isNull()) return false;
+                if (holders.isEmpty() || key < smallest) {
+                    smallest = key;
+                    holders = { i };
+                } else if (key == smallest) {
+                    holders.append(i);
+                }
+            }
+            if (holders.isEmpty()) return true;
+            if (!visit(smallest, holders, positions)) return false;
+            for (int i : qAsConst(holders)) ++positions[i];
+        }
+    };
+
+    quint64 termCount = 0, keysSize = 0;
+    bool counted = forEachTerm([&](const QByteArray &key, const QVector<int> &, const QVector<quint32> &) {
+        ++termCount;
+        keysSize += quint64(key.size());
+        return true;
+    });
+    quint64 listsStart = headerSize + termCount * directoryEntrySize + keysSize;
+    if (!counted || listsStart > std::numeric_limits<quint32>::max()) return false;
+
+    QSaveFile out(path);
+    if (!out.open(QIODevice::WriteOnly) || !out.seek(qint64(listsStart))) return false;
+
+    QByteArray directory, keys;
+    directory.reserve(int(qMin<quint64>(termCount * directoryEntrySize, 1 << 30)));
+    quint64 listOffset = listsStart;
+    const int blockSize = int(postingBlockSize);
+    bool written = forEachTerm([&](const QByteArray &key, const QVector<int> &holders, const QVector<quint32> &positions) {
+        quint64 count = 0;
+        for (int i : holders) count += qFromLittleEndian<quint32>(entryAt(inputs[i], positions[i]) + 8);
+        if (count > std::numeric_limits<quint32>::max()) return false;
+
+        // Входы идут по возрастанию base и не пересекаются, так что склейка уже отсортирована
+        QByteArray skips, deltas;
+        skips.reserve(int((count + blockSize - 1) / blockSize * skipEntrySize));
+        quint64 index = 0;
+        quint32 previous = 0;
+        for (int i : holders) {
+            const Segment &segment = inputs[i];
+            const uchar *entry = entryAt(segment, positions[i]);
+            quint32 length = qFromLittleEndian<quint32>(entry + 16);
+            quint32 offset = qFromLittleEndian<quint32>(entry + 12);
+            if (quint64(offset) + length > quint64(segment.size)) return false;
+            quint32 shift = quint32(segment.base - base);
+            for (Cursor cursor(segment.data + offset, length, qFromLittleEndian<quint32>(entry + 8)); !cursor.atEnd(); cursor.next()) {
+                quint32 value = cursor.value() + shift;
+                if (index++ % blockSize == 0) {
+                    appendLittleEndian32(skips, value);
+                    appendLittleEndian32(skips, quint32(deltas.size()));
+                } else {
+                    quint32 delta = value - previous;
+                    while (delta >= 0x80) {
+                        deltas.append(char((delta & 0x7f) | 0x80));
+                        delta >>= 7;
+                    }
+                    deltas.append(char(delta));
+                }
+                previous = value;
+            }
+        }
+        if (index != count) return false; // Повреждённый список оборвался раньше
+
+        quint64 listLength = quint64(skips.size()) + quint64(deltas.size());
+        if (listOffset + listLength > std::numeric_limits<quint32>::max()) return false;
+        appendLittleEndian32(directory, quint32(headerSize + termCount * directoryEntrySize + keys.size()));
+        appendLittleEndian32(directory, quint32(key.size()));
+        appendLittleEndian32(directory, quint32(count));
+        appendLittleEndian32(directory, quint32(listOffset));
+        appendLittleEndian32(directory, quint32(listLength));
+        keys += key;
+        listOffset += listLength;
+        return out.write(skips) == skips.size() && out.write(deltas) == deltas.size();
+    });
+    if (!written) {
+        out.cancelWriting();
+        return false;
+    }
+
+    QByteArray header;
+    appendLittleEndian32(header, segmentMagic);
+    appendLittleEndian32(header, segmentVersion);
+    appendLittleEndian64(header, base);
+    appendLittleEndian32(header, quint32(docCount));
+    appendLittleEndian32(header, quint32(termCount));
+    if (!out.seek(0) || out.write(header) != header.size() || out.write(directory) != directory.size()
+        || out.write(keys) != keys.size()) {
+        out.cancelWriting();
+        return false;
+    }
+    return out.commit();
+}
+
+QString SearchIndex::segmentPath(quint64 base) const
+{
+    return QDir(directory).filePath(QString("segment-%1.seg").arg(base, 20, 10, QChar('0')));
+}
+
+bool SearchIndex::mapSegment(Segment &segment)
+{
+    if (segment.file) {
+        segment.size = segment.file->size();
+        segment.data = segment.size >= headerSize ? segment.file->map(0, segment.size) : nullptr;
+    } else {
+        segment.size = segment.bytes.size();
+        segment.data = reinterpret_cast<const uchar *>(segment.bytes.constData());
+    }
+    if (!segment.data || segment.size < headerSize) return false;
+
+    const uchar *data = segment.data;
+    if (qFromLittleEndian<quint32>(data) != segmentMagic || qFromLittleEndian<quint32>(data + 4) != segmentVersion) {
+        return false;
+    }
+    segment.base = qFromLittleEndian<quint64>(data + 8);
+    segment.docCount = qFromLittleEndian<quint32>(data + 16);
+    segment.termCount = qFromLittleEndian<quint32>(data + 20);
+
+    // Только размер каталога: термы и списки проверяются при чтении
+    return quint64(segment.size - headerSize) / directoryEntrySize >= segment.termCount;
+}
+
+SearchIndex::Cursor SearchIndex::find(const Segment &segment, const QString &term)
+{
+    const QByteArray key = term.toUtf8();
+    const uchar *directory = segment.data + headerSize;
+    quint32 low = 0;
+    quint32 high = segment.termCount;
+    while (low < high) {
+        quint32 middle = low + (high - low) / 2;
+        const uchar *entry = directory + quint64(middle) * directoryEntrySize;
+        quint32 keyOffset = qFromLittleEndian<quint32>(entry);
+        quint32 keyLength = qFromLittleEndian<quint32>(entry + 4);
+        if (quint64(keyOffset) + keyLength > quint64(segment.size)) return Cursor();
+
+        // Тот же порядок, что у QByteArray при записи: побайтово, короткое раньше
+        quint32 keySize = quint32(key.size());
+        int order = std::memcmp(segment.data + keyOffset, key.constData(), qMin(keyLength, keySize));
+        if (order == 0) order = keyLength < keySize ? -1 : (keyLength > keySize ? 1 : 0);
+
+        if (order < 0) {
+            low = middle + 1;
+        } else if (order > 0) {
+            high = middle;
+        } else {
+            quint32 count = qFromLittleEndian<quint32>(entry + 8);
+            quint32 offset = qFromLittleEndian<quint32>(entry + 12);
+            quint32 length = qFromLittleEndian<quint32>(entry + 16);
+            if (quint64(offset) + length > quint64(segment.size)) return Cursor();
+            return Cursor(segment.data + offset, length, count);
+        }
+    }
+    return Cursor();
+}
+
+QByteArray SearchIndex::encodeSegment(quint64 base, quint32 docCount, const QHash<QString, QVector<quint32>> &postings)
+{
+    // Каталог по возрастанию байтов UTF-8, как сравнивает find()
+    QVector<QPair<QByteArray, const QVector<quint32> *>> terms;
+    terms.reserve(postings.size());
+    for (auto it = postings.constBegin(); it != postings.constEnd(); ++it) {
+        terms.append(qMakePair(it.key().toUtf8(), &it.value()));
+    }
+    std::sort(terms.begin(), terms.end(), [](const QPair<QByteArray, const QVector<quint32> *> &a,
+                                             const QPair<QByteArray, const QVector<quint32> *> &b) {
+        return a.first < b.first;
+    });
+
+    QByteArray keys;
+    for (const auto &term : qAsConst(terms)) {
+        keys += term.first;
+    }
+
+    QByteArray directory, lists;
+    quint32 keyOffset = headerSize + quint32(terms.size()) * directoryEntrySize;
+    quint32 listsStart = keyOffset + quint32(keys.size());
+    for (const auto &term : qAsConst(terms)) {
+        QByteArray encoded = encodePostings(*term.second);
+        appendLittleEndian32(directory, keyOffset);
+        appendLittleEndian32(directory, quint32(term.first.size()));
+        appendLittleEndian32(directory, quint32(term.second->size()));
+        appendLittleEndian32(directory, listsStart + quint32(lists.size()));
+        appendLittleEndian32(directory, quint32(encoded.size()));
+        keyOffset += quint32(term.first.size());
+        lists += encoded;
+    }
+
+    QByteArray out;
+    out.reserve(headerSize + directory.size() + keys.size() + lists.size());
+    appendLittleEndian32(out, segmentMagic);
+    appendLittleEndian32(out, segmentVersion);
+    appendLittleEndian64(out, base);
+    appendLittleEndian32(out, docCount);
+    appendLittleEndian32(out, quint32(terms.size()));
+    out += directory;
+    out += keys;
+    out += lists;
+    return out;
+}
+
+// Таблица пропусков (первое значение и смещение каждого блока), затем блоки:
+// разности соседних значений в varint, первое значение блока — в таблице
+QByteArray SearchIndex::encodePostings(const QVector<quint32> &list)
+{
+    const int blockSize = int(postingBlockSize);
+    QByteArray skips, deltas;
+    skips.reserve((list.size() + blockSize - 1) / blockSize * skipEntrySize);
+    deltas.reserve(list.size());
+    for (int i = 0; i < list.size(); ++i) {
+        if (i % blockSize == 0) {
+            appendLittleEndian32(skips, list[i]);
+            appendLittleEndian32(skips, quint32(deltas.size()));
+            continue;
+        }
+        quint32 delta = list[i] - list[i - 1];
+        while (delta >= 0x80) {
+            deltas.append(char((delta & 0x7f) | 0x80));
+            delta >>= 7;
+        }
+        deltas.append(char(delta));
+    }
+    return skips + deltas;
+}
+
+// Пересечение ведёт самый редкий терм: остальные списки и списки видимости
+// только перепрыгивают к его кандидатам, не разбираясь целиком
+QVector<quint32> SearchIndex::match(QVector<Cursor> &termCursors, QVector<Cursor> &visibleCursors)
+{
+    QVector<quint32> result;
+    if (termCursors.isEmpty() || visibleCursors.isEmpty()) return result;
+
+    std::sort(termCursors.begin(), termCursors.end(), [](const Cursor &a, const Cursor &b) {
+        return a.size() < b.size();
+    });
+
+    Cursor &lead = termCursors[0];
+    while (!lead.atEnd()) {
+        quint32 candidate = lead.value();
+        bool agreed = true;
+        for (int i = 1; i < termCursors.size(); ++i) {
+            Cursor &other = termCursors[i];
+            other.seek(candidate);
+            if (other.atEnd()) return result;
+            if (other.value() != candidate) {
+                lead.seek(other.value());
+                agreed = false;
+                break;
+            }
+        }
+        if (!agreed) continue;
+
+        for (Cursor &visible : visibleCursors) {
+            visible.seek(candidate);
+            if (!visible.atEnd() && visible.value() == candidate) {
+                result.append(candidate);
+                break;
+            }
+        }
+        lead.next();
+    }
+    return result;
+}
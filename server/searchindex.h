@@ -0,0 +1,105 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QVector>
+#include <QByteArray>
+#include <QFile>
+#include <QAtomicInt>
+#include <QThreadPool>
+#include <memory>
+
+// Инвертированный индекс по журналу сообщений.
+// Новые сообщения попадают в изменяемый сегмент; когда он набирает
+// segmentSize документов, сегмент записывается на диск и дальше читается
+// через отображение в память. В файле сегмента — отсортированный каталог
+// термов и списки вхождений блоками по postingBlockSize: разности id в
+// varint и таблица пропусков с первым id каждого блока. Открытие читает
+// только заголовки, а поиск — каталог и те блоки, куда попадает пересечение.
+// После перезапуска индексируется только хвост журнала, не попавший в
+// сохранённые сегменты.
+//
+// Дескриптор файла закрывается сразу после отображения. Чтобы отображений
+// не становилось больше с каждым сегментом, mergeFactor соседних сегментов
+// одного яруса сливаются в фоне в один следующего яруса; результат
+// подменяет их при следующем add().
+//
+// Видимость хранится в том же индексе служебными термами (userTerm, dmTerm,
+// roomTerm), поэтому фильтрация не требует чтения самих сообщений.
+class SearchIndex
+{
+public:
+    ~SearchIndex();
+
+    bool open(const QString &directory);
+    quint64 indexedUpTo() const; // Последний проиндексированный id
+    qint64 memoryUsage() const; // Примерно, в байтах: куча изменяемого сегмента, сохранённые только отображены
+    int segmentCount() const { return sealed.size(); }
+
+    void add(quint64 id, const QString &sender, const QString &recipient, const QString &text);
+
+    // id документов, содержащих все terms и хотя бы один из visibleTerms, от новых к старым
+    QVector<quint64> search(const QStringList &terms, const QStringList &visibleTerms, int limit) const;
+
+    // id документов с термом term больше afterId, от старых к новым (для догрузки истории)
+    QVector<quint64> postingsAfter(const QString &term, quint64 afterId, int limit) const;
+
+    static QStringList tokenize(const QString &text);
+    static QString userTerm(const QString &username);
+    static QString dmTerm(const QString &first, const QString &second);
+    static QString roomTerm(const QString &room);
+
+private:
+    class Cursor;
+
+    struct Segment
+    {
+        quint64 base = 0; // id первого документа сегмента
+        quint32 docCount = 0;
+        quint32 termCount = 0;
+        std::shared_ptr<QFile> file; // Отображён в память и закрыт, отображение живёт вместе с объектом
+        QByteArray bytes; // Если файл не записался или не отобразился, сегмент живёт здесь
+        const uchar *data = nullptr;
+        qint64 size = 0;
+    };
+
+    static constexpr quint32 segmentSize = 65536;
+    static constexpr quint32 postingBlockSize = 128;
+    static constexpr int mergeFactor = 8;
+    static constexpr int maxMergeTier = 3; // Ярус 3 — до 8^3 исходных сегментов, около 33 млн сообщений, дальше не сливается
+
+    struct Merge
+    {
+        QVector<Segment> inputs; // Подряд идущие сегменты, копии держат их отображения
+        QString path; // Путь первого входа: слитый файл подменяет его
+        bool ok = false;
+        QAtomicInt done;
+    };
+
+    QString directory;
+    QVector<Segment> sealed; // По возрастанию base
+    quint64 activeBase = 1;
+    quint32 activeCount = 0;
+    QHash<QString, QVector<quint32>> activePostings;
+    qint64 activeHeapBytes = 0; // Ведутся в add() и seal(), чтобы STATS не обходил все термы
+    qint64 sealedHeapBytes = 0; // Сегменты, оставшиеся в куче из-за ошибки записи
+    std::shared_ptr<Merge> merge; // Не больше одного слияния за раз
+    QThreadPool pool; // Один поток для слияний
+
+    void seal();
+    void startMerge();
+    void finishMerge();
+    static int tier(quint32 docCount);
+    static bool writeMerged(const QVector<Segment> &inputs, const QString &path);
+    QString segmentPath(quint64 base) const;
+    static bool mapSegment(Segment &segment);
+
+    static Cursor find(const Segment &segment, const QString &term);
+    static QByteArray encodeSegment(quint64 base, quint32 docCount, const QHash<QString, QVector<quint32>> &postings);
+    static QByteArray encodePostings(const QVector<quint32> &list);
+    static QVector<quint32> match(QVector<Cursor> &termCursors, QVector<Cursor> &visibleCursors);
+};
+
+#endif // SEARCHINDEX_H
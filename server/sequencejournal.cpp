@@ -0,0 +1,69 @@
+#include "sequencejournal.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+
+bool SequenceJournal::open(const QString &path)
+{
+    file.close();
+    marks.clear();
+    if (!QDir().mkpath(QFileInfo(path).path())) return false;
+
+    file.setFileName(path);
+    if (file.open(QIODevice::ReadOnly)) {
+        while (!file.atEnd()) {
+            QByteArray line = file.readLine().trimmed();
+            int space = line.lastIndexOf(' ');
+            bool ok = false;
+            quint64 sequence = line.mid(space + 1).toULongLong(&ok);
+            if (space <= 0 || !ok) continue; // Недописанная строка после аварийного завершения
+            marks.insert(QString::fromUtf8(line.left(space)), sequence);
+        }
+        file.close();
+    }
+
+    compact();
+    return file.isOpen();
+}
+
+int SequenceJournal::count() const
+{
+    return marks.size();
+}
+
+quint64 SequenceJournal::value(const QString &key) const
+{
+    return marks.value(key);
+}
+
+void SequenceJournal::setValue(const QString &key, quint64 sequence)
+{
+    marks.insert(key, sequence);
+    if (!file.isOpen()) return;
+
+    // Сбрасываем сразу, как и журнал сообщений: номер не должен отстать от сохранённого сообщения
+    file.write(key.toUtf8() + ' ' + QByteArray::number(sequence) + '\n');
+    file.flush();
+    if (++lines >= minCompactLines && lines > 2 * marks.size()) compact();
+}
+
+void SequenceJournal::compact()
+{
+    file.close();
+
+    QSaveFile out(file.fileName());
+    if (out.open(QIODevice::WriteOnly)) {
+        QByteArray buffer;
+        for (auto it = marks.cbegin(); it != marks.cend(); ++it) {
+            buffer += it.key().toUtf8() + ' ' + QByteArray::number(it.value()) + '\n';
+            if (buffer.size() >= (1 << 20)) {
+                out.write(buffer);
+                buffer.clear();
+            }
+        }
+        out.write(buffer);
+        if (out.commit()) lines = marks.size();
+    }
+
+    file.open(QIODevice::WriteOnly | QIODevice::Append);
+}
@@ -0,0 +1,33 @@
+#ifndef SEQUENCEJOURNAL_H
+#define SEQUENCEJOURNAL_H
+
+#include <QFile>
+#include <QHash>
+#include <QString>
+
+// Последние принятые номера SEND, чтобы повтор отсеялся и после перезапуска.
+// Номер меняется с каждым сообщением, поэтому он не в снимке учётных записей
+// (тот пришлось бы переписывать целиком), а в отдельном журнале строк
+// "<ключ> <номер>": каждое изменение дописывается в конец, действует
+// последняя строка ключа. Когда старых строк становится больше, чем живых,
+// журнал переписывается по одной строке на ключ.
+class SequenceJournal
+{
+public:
+    bool open(const QString &path);
+    int count() const;
+
+    quint64 value(const QString &key) const; // 0, если номеров ещё не было
+    void setValue(const QString &key, quint64 sequence);
+
+private:
+    static constexpr int minCompactLines = 4096;
+
+    QFile file;
+    QHash<QString, quint64> marks;
+    int lines = 0; // Строк в файле
+
+    void compact();
+};
+
+#endif // SEQUENCEJOURNAL_H
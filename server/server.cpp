@@ -1,35 +1,182 @@
 #include "server.h"
 #include <QDebug>
 #include <QDateTime>
+#include "messagefilters.h"
+#include <QRandomGenerator>
+#include <QSslCertificate>
+#include <QSslKey>
+#include <QThread>
 
-Server::Server(QObject *parent) : QTcpServer(parent) {}
+Server::Server(QObject *parent)
+    : QTcpServer(parent)
+    , dataChannel(&blobStore, this)
+    , heartbeatWheel(500, 128, this) // Тик 0.5 с, один оборот колеса 64 с
+{
+    clock.start();
+    connect(&heartbeatWheel, &TimingWheel::expired, this, &Server::onHeartbeatExpired);
+    connect(&pipeline, &MessagePipeline::filtered, this, &Server::onMessageFiltered);
+
+    snapshotTimer.setInterval(snapshotInterval);
+    connect(&snapshotTimer, &QTimer::timeout, &accounts, &AccountStore::saveSnapshot);
+    connect(&accounts, &AccountStore::snapshotSaved, this, [this](bool ok, quint64 count, qint64 elapsedMs) {
+        logAction(ok ? QString("State snapshot saved: %1 accounts in %2 ms").arg(count).arg(elapsedMs)
+                     : QString("Failed to save the state snapshot"));
+    });
+}
+
+bool Server::startServer(bool plaintext)
+{
+    openAccounts(); // Первым: без учётных записей нельзя принимать LOGIN
+    openMessageHistory();
+    loadModerationRules();
+
+    if (plaintext && !listen(QHostAddress::Any, 1234)) // Слушаем на порту 1234
+        return false;
+
+    // Без файлового канала чат работает, просто без вложений
+    if (!blobStore.open(blobDirPath) || !dataChannel.listen(QHostAddress::Any, dataPort)) {
+        logAction("Failed to start the file channel, attachments are disabled");
+    } else {
+        dataChannel.sweepPartials(); // Брошенные до перезапуска загрузки
+    }
+
+    heartbeatWheel.start();
+    snapshotTimer.start();
+    return true;
+}
+
+bool Server::startTls(const QString &certificatePath, const QString &keyPath, quint16 port)
+{
+    QFile certificateFile(certificatePath);
+    QFile keyFile(keyPath);
+    if (!certificateFile.open(QIODevice::ReadOnly) || !keyFile.open(QIODevice::ReadOnly)) return false;
+
+    QList<QSslCertificate> chain = QSslCertificate::fromDevice(&certificateFile, QSsl::Pem);
+    QByteArray keyData = keyFile.readAll();
+    QSslKey key(keyData, QSsl::Ec, QSsl::Pem);
+    if (key.isNull()) key = QSslKey(keyData, QSsl::Rsa, QSsl::Pem);
+    if (chain.isEmpty() || key.isNull()) return false;
+
+    QSslConfiguration configuration = QSslConfiguration::defaultConfiguration();
+    configuration.setLocalCertificateChain(chain);
+    configuration.setPrivateKey(key);
+    configuration.setProtocol(QSsl::TlsV1_2OrLater);
+    configuration.setPeerVerifyMode(QSslSocket::VerifyNone); // Клиенты входят паролем, не сертификатом
 
-bool Server::startServer()
+    tlsListener = new TlsListener(configuration, QThread::idealThreadCount(), this);
+    connect(tlsListener, &TlsListener::clientReady, this, &Server::addClient);
+    if (!tlsListener->listen(QHostAddress::Any, port)) {
+        delete tlsListener;
+        tlsListener = nullptr;
+        return false;
+    }
+    logAction(QString("TLS listener on port %1").arg(port));
+    return true;
+}
+
+bool Server::startCapture(const QString &path)
+{
+    if (!capture.open(path)) return false;
+    logAction("Capturing inbound traffic to " + path);
+    return true;
+}
+
+void Server::startTracing(int sampleEvery)
 {
-    return listen(QHostAddress::Any, 1234); // Слушаем на порту 1234
+    LatencyTrace::setEnabled(true, sampleEvery);
+    logAction(sampleEvery > 0 ? QString("Latency tracing on, sampling 1 in %1 messages").arg(sampleEvery)
+                              : QString("Latency tracing on for messages tagged by clients"));
+}
+
+void Server::setFloodLimit(double rate, int burst)
+{
+    floodRate = rate;
+    floodBurst = burst;
+}
+
+QString Server::dumpTrace(const QString &fileName)
+{
+    QString path = fileName.isEmpty() ? QDateTime::currentDateTime().toString("'trace-'yyyyMMdd-hhmmss'.json'") : fileName;
+    if (!LatencyTrace::dump(path, "server")) {
+        logAction("Failed to write the latency trace to " + path);
+        return QString();
+    }
+    logAction("Latency trace written to " + path);
+    return path;
 }
 
 void Server::incomingConnection(qintptr socketDescriptor)
 {
     QTcpSocket *clientSocket = new QTcpSocket(this);
     if (clientSocket->setSocketDescriptor(socketDescriptor)) {
-        connect(clientSocket, &QTcpSocket::readyRead, this, &Server::onReadyRead);
-        connect(clientSocket, &QTcpSocket::disconnected, this, &Server::onClientDisconnected);
-        clients.insert(clientSocket);
-        logAction("New client connected");
+        addClient(clientSocket);
     } else {
         delete clientSocket;
     }
 }
 
+void Server::addClient(QTcpSocket *clientSocket)
+{
+    clientSocket->setParent(this);
+    connect(clientSocket, &QTcpSocket::readyRead, this, &Server::onReadyRead);
+    connect(clientSocket, &QTcpSocket::disconnected, this, &Server::onClientDisconnected);
+    clients.insert(clientSocket);
+    connectionIds.insert(clientSocket, nextConnectionId);
+    capture.connected(nextConnectionId++);
+    lastActivity.insert(clientSocket, clock.elapsed());
+    heartbeatWheel.schedule(clientSocket, idleTimeout);
+    logAction("New client connected");
+
+    // После TLS-рукопожатия в буфере уже может лежать LOGIN, readyRead по нему не повторится
+    if (clientSocket->bytesAvailable() > 0) readClient(clientSocket);
+}
+
 void Server::onReadyRead()
 {
     QTcpSocket *client = qobject_cast<QTcpSocket *>(sender());
-    if (!client) return;
+    if (client) readClient(client);
+}
+
+void Server::readClient(QTcpSocket *client)
+{
+    qint64 readStart = LatencyTrace::isEnabled() ? LatencyTrace::now() : 0;
+    lastActivity[client] = clock.elapsed();
+    awaitingPong.remove(client);
+
+    // Разбираем только завершённые строки, хвост ждёт следующей порции данных
+    QByteArray &buffer = readBuffers[client];
+    buffer.append(client->readAll());
+    int end = buffer.lastIndexOf('\n');
 
-    QByteArray data = client->readAll();
-    QString message = QString::fromUtf8(data).trimmed();
-    processMessage(client, message);
+    // Незавершённый хвост не должен расти бесконечно, если '\n' так и не придёт
+    if (buffer.size() - end - 1 > maxLineLength) {
+        logAction(QString("Line longer than %1 bytes from %2, closing the connection")
+                      .arg(maxLineLength).arg(userMap.value(client, "Unknown")));
+        client->abort(); // Остальное уберёт onClientDisconnected
+        return;
+    }
+    if (end < 0) return;
+
+    QByteArray frames = buffer.left(end);
+    buffer.remove(0, end + 1);
+    qint64 readEnd = readStart ? LatencyTrace::now() : 0;
+
+    quint32 connectionId = connectionIds.value(client);
+    for (QByteArray frame : frames.split('\n')) {
+        capture.frame(connectionId, frame);
+
+        // Префикс трассы снимаем всегда; без него сервер может начать трассу сам
+        quint64 traceId = LatencyTrace::takeFramePrefix(frame);
+        if (!traceId) traceId = LatencyTrace::sample();
+        if (traceId && readStart) LatencyTrace::record("read", traceId, readStart, readEnd);
+
+        currentTraceId = traceId;
+        {
+            LatencyTrace::ScopedSpan span("process", traceId);
+            processMessage(client, QString::fromUtf8(frame).trimmed());
+        }
+        currentTraceId = 0;
+    }
 }
 
 void Server::onClientDisconnected()
@@ -37,15 +184,42 @@ void Server::onClientDisconnected()
     QTcpSocket *client = qobject_cast<QTcpSocket *>(sender());
     if (client) {
         QString username = userMap.value(client, "Unknown");
+        bool wasLoggedIn = userMap.contains(client);
         clients.remove(client);
         userMap.remove(client);
+        capture.disconnected(connectionIds.take(client));
+        readBuffers.remove(client);
+        lastActivity.remove(client);
+        awaitingPong.remove(client);
+        tracedWrites.remove(client);
+        heartbeatWheel.cancel(client);
+        dataChannel.revokeToken(dataTokens.take(client));
+        clientIds.remove(client);
         activeSessions.remove(username);
-        updateClientList();
+        if (wasLoggedIn) notifyPresence(username, false);
         client->deleteLater();
         logAction(username + " disconnected");
     }
 }
 
+void Server::onHeartbeatExpired(QTcpSocket *client)
+{
+    if (!clients.contains(client)) return;
+
+    qint64 idle = clock.elapsed() - lastActivity.value(client);
+    if (idle < idleTimeout) {
+        // Клиент был активен, таймер просто сдвигаем на остаток
+        heartbeatWheel.schedule(client, int(idleTimeout - idle));
+    } else if (!awaitingPong.contains(client)) {
+        client->write("PING\n");
+        awaitingPong.insert(client);
+        heartbeatWheel.schedule(client, pongTimeout);
+    } else {
+        logAction(userMap.value(client, "Unknown") + " timed out");
+        client->abort(); // Дальше обычный путь через onClientDisconnected
+    }
+}
+
 void Server::processMessage(QTcpSocket *client, const QString &message)
 {
     QStringList parts = message.split(" ", Qt::SkipEmptyParts);
@@ -57,28 +231,154 @@ void Server::processMessage(QTcpSocket *client, const QString &message)
         registerUser(client, parts[1], parts[2]);
     } else if (command == "LOGIN" && parts.size() == 3) {
         loginUser(client, parts[1], parts[2]);
+    } else if (command == "RESUME" && parts.size() == 2) {
+        resumeSession(client, parts[1]);
     } else if (command == "MSG" && parts.size() > 2) {
-        QString recipient = parts[1];
         QString chatMessage = message.section(' ', 2); // Извлекаем сообщение без команды "MSG" и получателя
-        QString sender = userMap.value(client, "Unknown");
-        if (recipient == "ALL") {
-            broadcastMessage(sender, chatMessage);
-        } else {
-            for (QTcpSocket *otherClient : qAsConst(clients)) {
-                if (userMap.value(otherClient) == recipient) {
-                    otherClient->write((sender + ": " + chatMessage + "\n").toUtf8());
-                    logAction(sender + " sent message to " + recipient + ": " + chatMessage);
-                    break;
-                }
-            }
-        }
+        submitMessage(client, 0, parts[1], chatMessage);
+    } else if (command == "CLIENT" && parts.size() == 2) {
+        setClientId(client, parts[1]);
+    } else if (command == "SEND" && parts.size() > 3) {
+        // SEND <номер> <получатель> <текст>: то же, что MSG, но с подтверждением ACK
+        QString chatMessage = message.section(' ', 3);
+        sendWithAck(client, parts[1].toULongLong(), parts[2], chatMessage);
     } else if (command == "LIST") {
         client->write((getUserList() + "\n").toUtf8());
+    } else if (command == "SEARCH" && parts.size() > 1) {
+        searchMessages(client, parts.mid(1));
+    } else if (command == "HISTORY" && parts.size() >= 3) {
+        sendHistory(client, parts[1], parts[2].toULongLong(), parts.size() > 3 ? parts[3].toInt() : 200);
+    } else if (command == "DATA") {
+        openDataChannel(client);
+    } else if (command == "STATS") {
+        sendStats(client);
+    } else if (command == "TRACE" && parts.size() > 1) {
+        controlTracing(client, parts.mid(1));
+    } else if (command == "PING") {
+        client->write("PONG\n");
+    } else if (command == "PONG") {
+        // Активность уже учтена в onReadyRead
     } else {
         client->write("ERROR Invalid command\n");
     }
 }
 
+void Server::submitMessage(QTcpSocket *client, quint64 sequence, const QString &recipient, const QString &chatMessage)
+{
+    if (recipient != "ALL" && !userExists(recipient)) {
+        // Личное сообщение несуществующему имени не храним и не индексируем:
+        // иначе его получит тот, кто зарегистрирует это имя позже
+        client->write("ERROR Unknown recipient\n");
+        if (sequence != 0) client->write(QString("REJECTED %1\n").arg(sequence).toUtf8());
+        return;
+    }
+
+    // Дальше сообщение идёт через фильтры, доставка и ACK — в onMessageFiltered
+    PipelineMessage message;
+    message.client = client;
+    message.sender = userMap.value(client);
+    message.recipient = recipient;
+    message.text = chatMessage;
+    message.sequence = sequence;
+    message.traceId = currentTraceId;
+    pipeline.submit(message);
+}
+
+void Server::onMessageFiltered(const PipelineMessage &message, bool accepted, const QString &reason, int retryAfter)
+{
+    QTcpSocket *client = message.client.data(); // nullptr, если отправитель уже отключился
+
+    if (!accepted && retryAfter > 0 && message.sequence != 0) {
+        // Временный отказ (частота): клиент оставит сообщение в очереди и
+        // повторит его под новым номером, этот уже учтён как принятый
+        if (client) client->write(QString("RETRY %1 %2\n").arg(message.sequence).arg(retryAfter).toUtf8());
+        return;
+    }
+    if (!accepted) {
+        logAction("Message from " + message.sender + " rejected: " + reason);
+        if (!client) return;
+        client->write(("ERROR Message rejected: " + reason + "\n").toUtf8());
+        // Отдельный ответ, а не ACK: клиент уберёт сообщение из очереди, но доставленным не сочтёт
+        if (message.sequence != 0) client->write(QString("REJECTED %1\n").arg(message.sequence).toUtf8());
+        return;
+    }
+
+    quint64 id = routeMessage(message.sender, message.recipient, message.text, message.traceId);
+    if (client && message.sequence != 0) {
+        client->write(QString("ACK %1 %2\n").arg(message.sequence).arg(id).toUtf8());
+        traceWrite(client, message.traceId);
+    }
+}
+
+// sender пустой, если отправитель не вошёл: такие сообщения не сохраняются
+quint64 Server::routeMessage(const QString &sender, const QString &recipient, const QString &chatMessage, quint64 traceId)
+{
+    LatencyTrace::ScopedSpan span("route", traceId);
+    QString senderName = sender.isEmpty() ? QString("Unknown") : sender;
+    quint64 id = 0;
+    if (!sender.isEmpty()) {
+        LatencyTrace::ScopedSpan storeSpan("store", traceId);
+        id = storeMessage(sender, recipient, chatMessage);
+    }
+    if (recipient == "ALL") {
+        broadcastMessage(senderName, chatMessage, id, traceId);
+    } else {
+        for (QTcpSocket *otherClient : qAsConst(clients)) {
+            if (userMap.value(otherClient) == recipient) {
+                QByteArray frame = QString("FROM %1 %2 %3\n").arg(id).arg(senderName, chatMessage).toUtf8();
+                if (traceId) frame.prepend(LatencyTrace::framePrefix(traceId)); // Получатель отметит у себя приём
+                otherClient->write(frame);
+                traceWrite(otherClient, traceId);
+                logAction(senderName + " sent message to " + recipient + ": " + chatMessage);
+                break;
+            }
+        }
+    }
+    return id;
+}
+
+void Server::sendWithAck(QTcpSocket *client, quint64 sequence, const QString &recipient, const QString &chatMessage)
+{
+    if (!userMap.contains(client)) {
+        client->write("ERROR Not logged in\n"); // Без ACK клиент оставит сообщение в очереди
+        return;
+    }
+
+    // Повтор после переподключения: уже принято, отвечаем DUP. Номера растут
+    // у каждой установки клиента по-своему, поэтому и сравниваются отдельно.
+    // Журнал хранит их на диске, так что повтор отсеется и после перезапуска
+    QString key = sequenceKey(client);
+    if (sequence <= sequences.value(key)) {
+        client->write(QString("DUP %1\n").arg(sequence).toUtf8());
+        return;
+    }
+    sequences.setValue(key, sequence);
+
+    submitMessage(client, sequence, recipient, chatMessage);
+}
+
+// CLIENT <id>: случайный id установки клиента, 1–32 шестнадцатеричные цифры
+void Server::setClientId(QTcpSocket *client, const QString &id)
+{
+    bool valid = !id.isEmpty() && id.size() <= 32;
+    for (QChar ch : id) {
+        if (!ch.isDigit() && (ch < QLatin1Char('a') || ch > QLatin1Char('f'))) valid = false;
+    }
+    if (!valid) {
+        client->write("ERROR Invalid client id\n");
+        return;
+    }
+    clientIds.insert(client, id);
+}
+
+// Без CLIENT (старые клиенты) номера считаются общими на пользователя
+QString Server::sequenceKey(QTcpSocket *client) const
+{
+    QString username = userMap.value(client);
+    QString id = clientIds.value(client);
+    return id.isEmpty() ? username : username + ' ' + id;
+}
+
 void Server::registerUser(QTcpSocket *client, const QString &username, const QString &password)
 {
     if (userExists(username)) {
@@ -96,6 +396,8 @@ void Server::registerUser(QTcpSocket *client, const QString &username, const QSt
 
     QTextStream out(&file);
     out << username << " " << password << "\n";
+    out.flush();
+    accounts.addUser(username, password, file.size());
     file.close();
 
     client->write("OK Registered successfully\n");
@@ -110,88 +412,474 @@ void Server::loginUser(QTcpSocket *client, const QString &username, const QStrin
         return;
     }
 
-    if (activeSessions.contains(username)) {
-        client->write("ERROR User already logged in\n");
-        logAction("Failed login attempt for already logged in user " + username);
-        return;
-    }
-
     QString storedPassword = getPasswordForUser(username);
     if (storedPassword == password) {
-        client->write("OK Logged in successfully\n");
-        userMap[client] = username;
-        activeSessions.insert(username);
-        updateClientList();
-        logAction("User logged in successfully: " + username);
+        ++passwordLogins;
+        beginSession(client, username);
     } else {
         client->write("ERROR Invalid password\n");
         logAction("Failed login attempt with invalid password for user " + username);
     }
 }
 
-bool Server::userExists(const QString &username)
+// RESUME <токен>: вход по токену из SESSION без пароля и чтения users.txt.
+// Токен одноразовый, взамен выдаётся новый.
+void Server::resumeSession(QTcpSocket *client, const QString &token)
 {
-    QFile file(userFilePath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return false;
-
-    QTextStream in(&file);
-    while (!in.atEnd()) {
-        QStringList line = in.readLine().split(" ");
-        if (line.size() >= 2 && line[0] == username) {
-            file.close();
-            return true;
+    ++resumeAttempts;
+    ResumeTicket ticket = resumeTickets.take(token);
+    if (!ticket.username.isEmpty()) ticketByUser.remove(ticket.username);
+    if (ticket.username.isEmpty() || ticket.expires < clock.elapsed()) {
+        client->write("ERROR Invalid session\n");
+        return;
+    }
+
+    ++resumedSessions;
+    beginSession(client, ticket.username);
+}
+
+void Server::beginSession(QTcpSocket *client, const QString &username)
+{
+    if (activeSessions.contains(username)) {
+        // Повторный вход (обычно переподключение) вытесняет старую сессию
+        for (QTcpSocket *otherClient : userMap.keys(username)) {
+            if (otherClient == client) continue;
+            otherClient->write("ERROR Session taken over\n");
+            otherClient->flush();
+            otherClient->abort(); // Очистка через onClientDisconnected
         }
+        logAction("Session of " + username + " taken over by a new connection");
     }
+    client->write(("OK Logged in successfully\nSESSION " + issueResumeTicket(username) + "\n").toUtf8());
+    userMap[client] = username;
+    activeSessions.insert(username);
+    notifyPresence(username, true);
+    logAction("User logged in successfully: " + username);
+}
 
-    file.close();
-    return false;
+// Новый вход отзывает прежний токен пользователя: после вытеснения сессии
+// её токен не должен впускать снова
+QString Server::issueResumeTicket(const QString &username)
+{
+    qint64 now = clock.elapsed();
+    resumeTickets.remove(ticketByUser.take(username));
+    if (resumeTickets.size() >= ticketSweepThreshold) {
+        for (auto it = resumeTickets.begin(); it != resumeTickets.end();) {
+            if (it->expires < now) {
+                ticketByUser.remove(it->username);
+                it = resumeTickets.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        ticketSweepThreshold = qMax(4096, resumeTickets.size() * 2);
+    }
+
+    quint32 words[4];
+    QRandomGenerator::system()->fillRange(words);
+    QString token = QString::fromLatin1(QByteArray(reinterpret_cast<const char *>(words), sizeof(words)).toHex());
+    resumeTickets.insert(token, ResumeTicket{username, now + resumeTicketLifetime});
+    ticketByUser.insert(username, token);
+    return token;
+}
+
+bool Server::userExists(const QString &username)
+{
+    return accounts.contains(username);
 }
 
 QString Server::getPasswordForUser(const QString &username)
 {
-    QFile file(userFilePath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return QString();
-
-    QTextStream in(&file);
-    while (!in.atEnd()) {
-        QStringList line = in.readLine().split(" ");
-        if (line.size() >= 2 && line[0] == username) {
-            file.close();
-            return line[1];
+    return accounts.password(username);
+}
+
+QString Server::getUserList() const
+{
+    // Только вошедшие пользователи: дальше клиенты следят за списком по JOIN/LEAVE
+    QStringList userList = userMap.values();
+    return "USERS " + userList.join(" ");
+}
+
+// DATA: порт и токен для передачи файлов отдельным соединением
+void Server::openDataChannel(QTcpSocket *client)
+{
+    if (!userMap.contains(client)) {
+        client->write("ERROR Not logged in\n");
+        return;
+    }
+    if (!dataChannel.isListening()) {
+        client->write("ERROR File transfer is unavailable\n");
+        return;
+    }
+
+    if (!dataTokens.contains(client)) {
+        dataTokens.insert(client, dataChannel.issueToken(userMap.value(client)));
+    }
+    client->write(QString("DATA %1 %2\n").arg(dataChannel.serverPort()).arg(dataTokens.value(client)).toUtf8());
+}
+
+// STATS: счётчики сервера строками "STAT <имя> <значение>", только с localhost
+void Server::sendStats(QTcpSocket *client)
+{
+    if (!client->peerAddress().isLoopback()) {
+        client->write("ERROR Stats are only available locally\n");
+        return;
+    }
+
+    QByteArray reply;
+    auto stat = [&reply](const QString &name, quint64 value) {
+        reply += QString("STAT %1 %2\n").arg(name).arg(value).toUtf8();
+    };
+    auto stageStats = [&stat](const StageStats &stats) {
+        stat(stats.name + ".calls", stats.calls);
+        stat(stats.name + ".rejected", stats.rejected);
+        stat(stats.name + ".avg_us", stats.calls ? stats.totalNs / stats.calls / 1000 : 0);
+        stat(stats.name + ".max_us", stats.maxNs / 1000);
+    };
+
+    stat("connections", quint64(clients.size()));
+    stat("users", quint64(userMap.size()));
+    stat("accounts.snapshot", accounts.snapshotCount());
+    stat("accounts.pending_changes", quint64(accounts.pendingChanges()));
+    stat("accounts.sequence_marks", quint64(sequences.count()));
+    stat("session.logins", passwordLogins);
+    stat("session.resume_attempts", resumeAttempts);
+    stat("session.resumed", resumedSessions);
+    stat("session.resume_ratio_pct", (passwordLogins + resumeAttempts) ? resumedSessions * 100 / (passwordLogins + resumeAttempts) : 0);
+    if (tlsListener) {
+        TlsStats tls = tlsListener->stats();
+        stat("tls.handshakes", tls.handshakes);
+        stat("tls.failures", tls.failures);
+        stat("tls.in_progress", quint64(tls.inProgress));
+        stat("tls.per_sec", quint64(tls.perSecond + 0.5));
+        stat("tls.avg_us", tls.handshakes ? tls.totalNs / tls.handshakes / 1000 : 0);
+        stat("tls.max_us", tls.maxNs / 1000);
+    }
+    stat("pipeline.pending", quint64(pipeline.pending()));
+    stageStats(pipeline.totalStats());
+    for (StageStats stats : pipeline.stageStats()) {
+        stats.name = "filter." + stats.name;
+        stageStats(stats);
+    }
+    stat("trace.enabled", LatencyTrace::isEnabled() ? 1 : 0);
+    stat("trace.sample_every", quint64(LatencyTrace::sampleRate()));
+
+    // Размеры внутренних контейнеров для поиска утечек (soak): всё, что
+    // заводится на соединение, должно исчезать вместе с ним
+    qint64 bufferedBytes = 0;
+    for (const QByteArray &buffer : qAsConst(readBuffers)) bufferedBytes += buffer.size();
+    stat("containers.clients", quint64(clients.size()));
+    stat("containers.user_map", quint64(userMap.size()));
+    stat("containers.active_sessions", quint64(activeSessions.size()));
+    stat("containers.connection_ids", quint64(connectionIds.size()));
+    stat("containers.read_buffers", quint64(readBuffers.size()));
+    stat("containers.read_buffer_bytes", quint64(bufferedBytes));
+    stat("containers.last_activity", quint64(lastActivity.size()));
+    stat("containers.awaiting_pong", quint64(awaitingPong.size()));
+    stat("containers.heartbeat_timers", quint64(heartbeatWheel.size()));
+    stat("containers.data_tokens", quint64(dataTokens.size()));
+    stat("containers.client_ids", quint64(clientIds.size()));
+    stat("containers.traced_writes", quint64(tracedWrites.size()));
+    stat("containers.child_objects", quint64(children().size()));
+    stat("containers.resume_tickets", quint64(resumeTickets.size()));
+    stat("containers.ticket_owners", quint64(ticketByUser.size()));
+    stat("containers.data_channel_tokens", quint64(dataChannel.tokenCount()));
+    stat("containers.data_channel_transfers", quint64(dataChannel.transferCount()));
+    stat("containers.pipeline_conversations", quint64(pipeline.conversationCount()));
+    stat("messages.stored", messageStore.count());
+    stat("memory.search_index_bytes", quint64(searchIndex.memoryUsage()));
+    stat("index.segments", quint64(searchIndex.segmentCount()));
+    reply += "STATS END\n";
+    client->write(reply);
+}
+
+// TRACE ON [N] | TRACE OFF | TRACE DUMP [файл]: трассировка задержки, только с localhost
+void Server::controlTracing(QTcpSocket *client, const QStringList &args)
+{
+    if (!client->peerAddress().isLoopback()) {
+        client->write("ERROR Tracing is only available locally\n");
+        return;
+    }
+
+    QString action = args[0];
+    if (action == "ON") {
+        startTracing(args.size() > 1 ? args[1].toInt() : 0);
+        client->write("OK Tracing on\n");
+    } else if (action == "OFF") {
+        LatencyTrace::setEnabled(false);
+        logAction("Latency tracing off");
+        client->write("OK Tracing off\n");
+    } else if (action == "DUMP") {
+        // Только имя файла: трасса пишется в рабочий каталог сервера
+        QString fileName = args.size() > 1 ? args[1] : QString();
+        if (fileName.contains('/') || fileName.contains('\\')) {
+            client->write("ERROR Invalid trace file name\n");
+            return;
         }
+        QString path = dumpTrace(fileName);
+        client->write(path.isEmpty() ? QByteArray("ERROR Cannot write trace\n") : ("TRACE SAVED " + path + "\n").toUtf8());
+    } else {
+        client->write("ERROR Invalid command\n");
     }
+}
 
-    file.close();
-    return QString();
+// Отрезок "send": от записи кадра до ухода его последнего байта из буфера сокета в ядро
+void Server::traceWrite(QTcpSocket *client, quint64 traceId)
+{
+    if (!traceId || !LatencyTrace::isEnabled()) return;
+
+    QVector<TracedWrite> &writes = tracedWrites[client];
+    if (writes.isEmpty()) connect(client, &QTcpSocket::bytesWritten, this, &Server::onTracedBytesWritten);
+    writes.append(TracedWrite{traceId, client->bytesToWrite(), LatencyTrace::now()});
 }
 
-QString Server::getUserList() const
+void Server::onTracedBytesWritten(qint64 bytes)
 {
-    QStringList userList;
-    for (QTcpSocket *client : clients) {
-        userList << userMap.value(client, "Unknown");
+    QTcpSocket *client = qobject_cast<QTcpSocket *>(sender());
+    auto it = tracedWrites.find(client);
+    if (it == tracedWrites.end()) return;
+
+    // Кадры уходят по порядку, поэтому готовые всегда в начале списка
+    qint64 now = LatencyTrace::now();
+    QVector<TracedWrite> &writes = it.value();
+    int done = 0;
+    for (TracedWrite &write : writes) {
+        write.remaining -= bytes;
+        if (write.remaining > 0) continue;
+        LatencyTrace::record("send", write.traceId, write.startNs, now);
+        ++done;
+    }
+    writes.remove(0, done);
+
+    if (writes.isEmpty()) {
+        disconnect(client, &QTcpSocket::bytesWritten, this, &Server::onTracedBytesWritten);
+        tracedWrites.erase(it);
     }
-    return userList.join("\n");
 }
 
-void Server::updateClientList()
+void Server::notifyPresence(const QString &username, bool online)
 {
-    QString userList = getUserList();
-    for (QTcpSocket *client : clients) {
-        client->write((userList + "\n").toUtf8());
+    QByteArray frame = ((online ? "JOIN " : "LEAVE ") + username + "\n").toUtf8();
+    for (QTcpSocket *client : qAsConst(clients)) {
+        client->write(frame);
     }
 }
 
-void Server::broadcastMessage(const QString &sender, const QString &message)
+void Server::broadcastMessage(const QString &sender, const QString &message, quint64 id, quint64 traceId)
 {
+    QByteArray frame = QString("BCAST %1 %2 %3\n").arg(id).arg(sender, message).toUtf8(); // Кодируем один раз на всех
+    if (traceId) frame.prepend(LatencyTrace::framePrefix(traceId));
     for (QTcpSocket *client : qAsConst(clients)) {
-        client->write((sender + ": " + message + "\n").toUtf8());
+        client->write(frame);
+        traceWrite(client, traceId);
     }
     logAction("Broadcast message from " + sender + ": " + message);
 }
 
+void Server::openAccounts()
+{
+    QElapsedTimer timer;
+    timer.start();
+    if (!accounts.open(userFilePath, stateDirPath + "/accounts.snap")) {
+        logAction("Cannot open the server state directory, snapshots are disabled");
+    }
+    if (!sequences.open(stateDirPath + "/sequences.log")) {
+        logAction("Cannot open the sequence journal, repeated SENDs will not be detected after a restart");
+    }
+    logAction(QString("Accounts loaded in %1 ms: %2 from snapshot, %3 replayed from %4")
+              .arg(timer.elapsed()).arg(accounts.snapshotCount()).arg(accounts.pendingChanges()).arg(userFilePath));
+
+    // Первый запуск без снимка: сразу пишем его, чтобы следующий старт был быстрым
+    if (accounts.pendingChanges() >= snapshotThreshold) accounts.saveSnapshot();
+}
+
+void Server::openMessageHistory()
+{
+    if (!messageStore.open(messageDirPath) || !searchIndex.open(messageDirPath + "/index")) {
+        logAction("Failed to open message history, search is disabled");
+        return;
+    }
+
+    // Доиндексируем хвост журнала, не попавший в сохранённые сегменты: обычно
+    // меньше одного сегмента, весь журнал — только если индекс удалён или устарел
+    QElapsedTimer timer;
+    timer.start();
+    quint64 first = searchIndex.indexedUpTo() + 1;
+    quint64 reindexed = messageStore.count() >= first ? messageStore.count() - first + 1 : 0;
+    StoredMessage message;
+    for (quint64 id = first; id <= messageStore.count(); ++id) {
+        if (messageStore.read(id, message)) {
+            searchIndex.add(id, message.sender, message.recipient, message.text);
+        }
+    }
+    logAction(QString("Message history opened: %1 messages, %2 reindexed in %3 ms")
+              .arg(messageStore.count()).arg(reindexed).arg(timer.elapsed()));
+}
+
+void Server::loadModerationRules()
+{
+    QSet<QString> bannedWords;
+    QFile wordsFile(bannedWordsPath);
+    if (wordsFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        const QStringList words = SearchIndex::tokenize(QString::fromUtf8(wordsFile.readAll()));
+        bannedWords = QSet<QString>(words.begin(), words.end());
+    }
+
+    QSet<QString> trusted;
+    QFile trustedFile(trustedUsersPath);
+    if (trustedFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QTextStream in(&trustedFile);
+        while (!in.atEnd()) {
+            QString name = in.readLine().trimmed();
+            if (!name.isEmpty()) trusted.insert(name);
+        }
+    }
+
+    if (floodRate > 0) pipeline.addFilter(new FloodFilter(floodRate, qMax(1, floodBurst)));
+    if (!bannedWords.isEmpty()) pipeline.addFilter(new BannedWordsFilter(bannedWords));
+    pipeline.setTrustedSenders(trusted);
+    QString flood = floodRate > 0 ? QString("%1 messages/s, bursts of %2").arg(floodRate).arg(qMax(1, floodBurst)) : QString("off");
+    logAction(QString("Moderation: flood limit %1, %2 banned words, %3 trusted users")
+              .arg(flood).arg(bannedWords.size()).arg(trusted.size()));
+}
+
+quint64 Server::storeMessage(const QString &sender, const QString &recipient, const QString &message)
+{
+    quint64 id = messageStore.append(sender, recipient, message);
+    if (id != 0) {
+        searchIndex.add(id, sender, recipient, message);
+    }
+    return id;
+}
+
+// SEARCH <слова> [@собеседник|#ALL] [лимит]
+void Server::searchMessages(QTcpSocket *client, QStringList args)
+{
+    if (!userMap.contains(client)) {
+        client->write("ERROR Not logged in\n");
+        return;
+    }
+    if (!messageStore.isOpen()) {
+        client->write("ERROR Search is unavailable\n");
+        return;
+    }
+
+    QString username = userMap.value(client);
+    int limit = 20;
+    bool isNumber = false;
+    int requested = args.last().toInt(&isNumber);
+    if (isNumber && args.size() > 1) {
+        limit = qBound(1, requested, 100);
+        args.removeLast();
+    }
+
+    // По умолчанию видны личные сообщения пользователя и общий чат
+    QStringList visibleTerms;
+    QString scope = args.last();
+    if (args.size() > 1 && scope.startsWith('@')) {
+        visibleTerms << SearchIndex::dmTerm(username, scope.mid(1));
+        args.removeLast();
+    } else if (args.size() > 1 && scope.startsWith('#')) {
+        if (scope != "#ALL") {
+            client->write("ERROR Unknown room\n");
+            return;
+        }
+        visibleTerms << SearchIndex::roomTerm("ALL");
+        args.removeLast();
+    } else {
+        visibleTerms << SearchIndex::userTerm(username) << SearchIndex::roomTerm("ALL");
+    }
+
+    QStringList terms = SearchIndex::tokenize(args.join(' '));
+    if (terms.isEmpty()) {
+        client->write("ERROR Empty search\n");
+        return;
+    }
+
+    QByteArray reply;
+    int found = 0;
+    StoredMessage message;
+    for (quint64 id : searchIndex.search(terms, visibleTerms, limit)) {
+        if (!messageStore.read(id, message)) continue;
+        QString time = QDateTime::fromMSecsSinceEpoch(message.timestamp).toString(Qt::ISODate);
+        reply += QString("RESULT %1 %2 %3 %4 %5\n").arg(id).arg(time, message.sender, message.recipient, message.text).toUtf8();
+        ++found;
+    }
+    reply += QString("SEARCH END %1\n").arg(found).toUtf8();
+    client->write(reply);
+}
+
+// HISTORY <@собеседник|#ALL> <после id> [лимит]: сообщения беседы новее afterId, от старых к новым
+void Server::sendHistory(QTcpSocket *client, const QString &scope, quint64 afterId, int limit)
+{
+    if (!userMap.contains(client)) {
+        client->write("ERROR Not logged in\n");
+        return;
+    }
+    if (!messageStore.isOpen()) {
+        client->write("ERROR History is unavailable\n");
+        return;
+    }
+
+    QString username = userMap.value(client);
+    QString conversation = scope.mid(1);
+    QString term;
+    if (scope.startsWith('@') && !conversation.isEmpty()) {
+        term = SearchIndex::dmTerm(username, conversation);
+    } else if (scope == "#ALL") {
+        term = SearchIndex::roomTerm(conversation);
+    } else {
+        client->write("ERROR Unknown conversation\n");
+        return;
+    }
+
+    QByteArray reply;
+    int sent = 0;
+    StoredMessage message;
+    for (quint64 id : searchIndex.postingsAfter(term, afterId, qBound(1, limit, 1000))) {
+        if (!messageStore.read(id, message)) continue;
+        reply += QString("HIST %1 %2 %3 %4\n").arg(conversation, QString::number(id), message.sender, message.text).toUtf8();
+        ++sent;
+    }
+    reply += QString("HISTEND %1 %2\n").arg(conversation, QString::number(sent)).toUtf8();
+    client->write(reply);
+}
+
 void Server::logAction(const QString &action)
 {
     QString logEntry = QDateTime::currentDateTime().toString("[yyyy-MM-dd hh:mm:ss] ") + action;
     qDebug() << logEntry;
 }
+
+void ServerBenchHook::addSession(Server &server, QTcpSocket *socket, const QString &username)
+{
+    server.accounts.addUser(username, "bench", 0); // Личные сообщения принимаются только существующим
+    server.clients.insert(socket);
+    server.userMap[socket] = username;
+    server.activeSessions.insert(username);
+}
+
+void ServerBenchHook::processLine(Server &server, QTcpSocket *client, const QString &line)
+{
+    server.processMessage(client, line);
+}
+
+QString ServerBenchHook::userList(const Server &server)
+{
+    return server.getUserList();
+}
+
+void ServerBenchHook::broadcast(Server &server, const QString &sender, const QString &text)
+{
+    server.broadcastMessage(sender, text, 0);
+}
+
+void ServerBenchHook::openMessageHistory(Server &server)
+{
+    server.openMessageHistory();
+}
+
+bool ServerBenchHook::deliversSynchronously(const Server &server)
+{
+    return server.pipeline.isEmpty();
+}
@@ -7,39 +7,153 @@
 #include <QTextStream>
 #include <QSet>
 #include <QMap>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QTimer>
+#include "timingwheel.h"
+#include "messagestore.h"
+#include "searchindex.h"
+#include "tracewriter.h"
+#include "blobstore.h"
+#include "datachannel.h"
+#include "messagepipeline.h"
+#include "tlslistener.h"
+#include "accountstore.h"
+#include "sequencejournal.h"
+#include "latencytrace.h"
 
 class Server : public QTcpServer
 {
     Q_OBJECT
+    friend class ServerBenchHook;
 
 public:
     Server(QObject *parent = nullptr);
-    bool startServer();
+    bool startServer(bool plaintext = true);
+    bool startTls(const QString &certificatePath, const QString &keyPath, quint16 port);
+    bool startCapture(const QString &path); // Запись всех входящих кадров для replay
+    void startTracing(int sampleEvery); // Трасса задержки для каждого N-го сообщения и всех помеченных клиентом
+    void setFloodLimit(double rate, int burst); // До startServer; по умолчанию частота не ограничена
+    QString dumpTrace(const QString &fileName = QString()); // Путь к файлу трассы или пустая строка при ошибке
 
 protected:
     void incomingConnection(qintptr socketDescriptor) override;
 
 private slots:
+    void addClient(QTcpSocket *clientSocket);
     void onReadyRead();
     void onClientDisconnected();
+    void onHeartbeatExpired(QTcpSocket *client);
+    void onMessageFiltered(const PipelineMessage &message, bool accepted, const QString &reason, int retryAfter);
+    void onTracedBytesWritten(qint64 bytes);
 
 private:
     QSet<QTcpSocket*> clients; // Список подключенных клиентов
     QMap<QTcpSocket*, QString> userMap; // Отображение клиентов на имена пользователей
     QSet<QString> activeSessions; // Активные сессии пользователей
+    QHash<QTcpSocket*, quint32> connectionIds; // Порядковые номера соединений для захвата трафика
+    quint32 nextConnectionId = 1;
+    QHash<QTcpSocket*, QByteArray> readBuffers; // Недочитанные строки протокола
+    QHash<QTcpSocket*, qint64> lastActivity; // Время последних входящих данных (мс от старта)
+    QSet<QTcpSocket*> awaitingPong; // Клиенты, которым отправлен PING без ответа
+    QHash<QTcpSocket*, QString> dataTokens; // Выданные по DATA токены файлового канала
+    QHash<QTcpSocket*, QString> clientIds; // Из CLIENT: номера SEND у каждой установки клиента свои
 
+    struct ResumeTicket
+    {
+        QString username;
+        qint64 expires = 0; // мс от старта сервера
+    };
+    QHash<QString, ResumeTicket> resumeTickets; // Токены SESSION для входа без пароля
+    QHash<QString, QString> ticketByUser; // Единственный действующий токен пользователя
+    int ticketSweepThreshold = 4096;
+    double floodRate = 0; // Сообщений в секунду от одного отправителя в среднем, 0 — без ограничения
+    int floodBurst = 0; // и подряд без пауз
+    quint64 passwordLogins = 0;
+    quint64 resumeAttempts = 0;
+    quint64 resumedSessions = 0;
+
+    AccountStore accounts; // Пароли, снимок в state/
+    SequenceJournal sequences; // Последние номера SEND по пользователям и установкам клиента
+    QTimer snapshotTimer;
+    MessageStore messageStore;
+    SearchIndex searchIndex;
+    TraceWriter capture;
+    BlobStore blobStore;
+    DataChannel dataChannel;
+    MessagePipeline pipeline;
+    TlsListener *tlsListener = nullptr;
+
+    struct TracedWrite
+    {
+        quint64 traceId = 0;
+        qint64 remaining = 0; // Сколько байт буфера сокета должно уйти, включая этот кадр
+        qint64 startNs = 0;
+    };
+    QHash<QTcpSocket*, QVector<TracedWrite>> tracedWrites; // Только трассируемые кадры в очереди сокета
+    quint64 currentTraceId = 0; // Трасса кадра, который сейчас разбирает processMessage
+    TimingWheel heartbeatWheel;
+    QElapsedTimer clock;
+
+    static constexpr int idleTimeout = 30000; // Через сколько мс тишины отправлять PING
+    static constexpr int pongTimeout = 10000; // Сколько мс ждать ответа на PING
+    static constexpr int maxLineLength = 1024 * 1024; // Байт в одной команде; длиннее — соединение закрывается
+    static constexpr quint16 dataPort = 1235; // Порт файлового канала
+    static constexpr qint64 resumeTicketLifetime = 10 * 60 * 1000; // мс
+    static constexpr int snapshotInterval = 60000; // мс между снимками состояния, если были изменения
+    static constexpr int snapshotThreshold = 10000; // Столько изменений после старта — снимок сразу
+
+    void readClient(QTcpSocket *client);
     void processMessage(QTcpSocket *client, const QString &message);
     void registerUser(QTcpSocket *client, const QString &username, const QString &password);
+    void submitMessage(QTcpSocket *client, quint64 sequence, const QString &recipient, const QString &chatMessage);
+    quint64 routeMessage(const QString &sender, const QString &recipient, const QString &chatMessage, quint64 traceId = 0);
+    void sendWithAck(QTcpSocket *client, quint64 sequence, const QString &recipient, const QString &chatMessage);
+    void setClientId(QTcpSocket *client, const QString &id);
+    QString sequenceKey(QTcpSocket *client) const;
     void loginUser(QTcpSocket *client, const QString &username, const QString &password);
-    void broadcastMessage(const QString &sender, const QString &message);
-    void updateClientList();
+    void resumeSession(QTcpSocket *client, const QString &token);
+    void beginSession(QTcpSocket *client, const QString &username);
+    QString issueResumeTicket(const QString &username);
+    void broadcastMessage(const QString &sender, const QString &message, quint64 id, quint64 traceId = 0);
+    void openAccounts();
+    void openMessageHistory();
+    void loadModerationRules();
+    quint64 storeMessage(const QString &sender, const QString &recipient, const QString &message);
+    void searchMessages(QTcpSocket *client, QStringList args);
+    void sendHistory(QTcpSocket *client, const QString &scope, quint64 afterId, int limit);
+    void openDataChannel(QTcpSocket *client);
+    void notifyPresence(const QString &username, bool online); // JOIN/LEAVE всем клиентам
+    void sendStats(QTcpSocket *client);
+    void controlTracing(QTcpSocket *client, const QStringList &args);
+    void traceWrite(QTcpSocket *client, quint64 traceId);
     void logAction(const QString &action);
 
     const QString userFilePath = "users.txt"; // Путь к файлу с пользователями
+    const QString messageDirPath = "messages"; // Журнал сообщений и сегменты поискового индекса
+    const QString stateDirPath = "state"; // Снимки состояния для быстрого перезапуска
+    const QString blobDirPath = "blobs"; // Вложения, по одному файлу на содержимое
+    const QString bannedWordsPath = "banned_words.txt"; // Слова через пробел или с новой строки
+    const QString trustedUsersPath = "trusted.txt"; // Отправители без проверок, по имени в строке
 
     bool userExists(const QString &username);
     QString getPasswordForUser(const QString &username);
     QString getUserList() const;
 };
 
+// Узкий вход для микробенчмарков (bench/): только замеряемые пути, без
+// доступа к остальному состоянию Server. Сокеты бенчмарк создаёт сам.
+class ServerBenchHook
+{
+public:
+    static void addSession(Server &server, QTcpSocket *socket, const QString &username); // Вошедший пользователь
+    static void processLine(Server &server, QTcpSocket *client, const QString &line);
+    static QString userList(const Server &server);
+    static void broadcast(Server &server, const QString &sender, const QString &text);
+    static void openMessageHistory(Server &server);
+    // Без фильтров сообщение доставляется прямо в processMessage; с ними
+    // замер показал бы только постановку в очередь конвейера
+    static bool deliversSynchronously(const Server &server);
+};
+
 #endif // SERVER_H
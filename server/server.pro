@@ -12,8 +12,32 @@ MOC_DIR = $$PWD/moc
 RCC_DIR = $$PWD/rcc
 
 SOURCES += main.cpp \
-           server.cpp
+           server.cpp \
+           timingwheel.cpp \
+           messagestore.cpp \
+           searchindex.cpp \
+           tracewriter.cpp \
+           blobstore.cpp \
+           datachannel.cpp \
+           messagepipeline.cpp \
+           messagefilters.cpp \
+           tlslistener.cpp \
+           accountstore.cpp \
+           sequencejournal.cpp
 
-HEADERS += server.h
+HEADERS += server.h \
+           timingwheel.h \
+           messagestore.h \
+           searchindex.h \
+           traceformat.h \
+           tracewriter.h \
+           blobstore.h \
+           datachannel.h \
+           messagepipeline.h \
+           messagefilters.h \
+           tlslistener.h \
+           accountstore.h \
+           sequencejournal.h \
+           latencytrace.h
 
 DESTDIR = $$PWD/../bin
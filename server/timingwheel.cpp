@@ -0,0 +1,72 @@
+#include "timingwheel.h"
+
+TimingWheel::TimingWheel(int tickInterval, int slotCount, QObject *parent)
+    : QObject(parent)
+    , tickInterval(tickInterval)
+    , buckets(slotCount)
+{
+    timer.setInterval(tickInterval);
+    timer.setTimerType(Qt::CoarseTimer);
+    connect(&timer, &QTimer::timeout, this, &TimingWheel::onTick);
+}
+
+void TimingWheel::start()
+{
+    timer.start();
+}
+
+void TimingWheel::stop()
+{
+    timer.stop();
+}
+
+void TimingWheel::schedule(QTcpSocket *client, int delay)
+{
+    cancel(client);
+
+    int ticks = qMax(1, (delay + tickInterval - 1) / tickInterval);
+    Entry entry;
+    entry.slot = (currentSlot + ticks) % buckets.size();
+    entry.rounds = (ticks - 1) / buckets.size();
+
+    buckets[entry.slot].insert(client);
+    entries.insert(client, entry);
+}
+
+void TimingWheel::cancel(QTcpSocket *client)
+{
+    auto it = entries.find(client);
+    if (it == entries.end()) return;
+
+    buckets[it->slot].remove(client);
+    entries.erase(it);
+}
+
+int TimingWheel::size() const
+{
+    return entries.size();
+}
+
+void TimingWheel::onTick()
+{
+    currentSlot = (currentSlot + 1) % buckets.size();
+
+    QVector<QTcpSocket*> fired;
+    QSet<QTcpSocket*> &bucket = buckets[currentSlot];
+    for (auto it = bucket.begin(); it != bucket.end();) {
+        Entry &entry = entries[*it];
+        if (entry.rounds > 0) {
+            --entry.rounds;
+            ++it;
+        } else {
+            fired.append(*it);
+            entries.remove(*it);
+            it = bucket.erase(it);
+        }
+    }
+
+    // Сигналы отправляем после обхода: обработчик может перепланировать или отменить таймер
+    for (QTcpSocket *client : qAsConst(fired)) {
+        emit expired(client);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include <QObject>
+#include <QTimer>
+#include <QTcpSocket>
+#include <QVector>
+#include <QSet>
+#include <QHash>
+
+// Хешированное колесо таймеров: один QTimer на все соединения.
+// Таймер попадает в ячейку (текущая + задержка) % slotCount, за тик
+// обрабатывается только одна ячейка, поэтому постановка и отмена стоят O(1).
+class TimingWheel : public QObject
+{
+    Q_OBJECT
+
+public:
+    TimingWheel(int tickInterval, int slotCount, QObject *parent = nullptr);
+
+    void start();
+    void stop();
+
+    void schedule(QTcpSocket *client, int delay); // Задержка в мс, повторный вызов перепланирует
+    void cancel(QTcpSocket *client);
+    int size() const;
+
+signals:
+    void expired(QTcpSocket *client);
+
+private slots:
+    void onTick();
+
+private:
+    struct Entry {
+        int slot;
+        int rounds; // Сколько полных оборотов колеса осталось до срабатывания
+    };
+
+    QTimer timer;
+    int tickInterval;
+    int currentSlot = 0;
+    QVector<QSet<QTcpSocket*>> buckets;
+    QHash<QTcpSocket*, Entry> entries;
+};
+
+#endif // TIMINGWHEEL_H
@@ -0,0 +1,127 @@
+#include "tlslistener.h"
+#include <QTimer>
+
+HandshakeWorker::HandshakeWorker(const QSslConfiguration &configuration, QThread *targetThread)
+    : configuration(configuration)
+    , targetThread(targetThread)
+{
+}
+
+void HandshakeWorker::handshake(qintptr socketDescriptor)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QSslSocket *socket = new QSslSocket; // Без родителя: потом сокет уедет в другой поток
+    socket->setSslConfiguration(configuration);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        delete socket;
+        emit finished(nullptr, timer.nsecsElapsed());
+        return;
+    }
+
+    // Не закончил рукопожатие вовремя — не держим поток и дескриптор
+    QTimer *timeout = new QTimer(socket);
+    timeout->setSingleShot(true);
+    connect(timeout, &QTimer::timeout, socket, &QSslSocket::abort);
+
+    connect(socket, &QSslSocket::encrypted, this, [this, socket, timer, timeout]() {
+        // Всё, что успело прийти после рукопожатия, остаётся в буфере сокета
+        disconnect(socket, nullptr, this, nullptr);
+        delete timeout; // Таймеры нельзя останавливать из чужого потока
+
+        socket->moveToThread(targetThread);
+        emit finished(socket, timer.nsecsElapsed());
+    });
+    auto fail = [this, socket, timer]() {
+        disconnect(socket, nullptr, this, nullptr);
+        socket->abort();
+        socket->deleteLater();
+        emit finished(nullptr, timer.nsecsElapsed());
+    };
+    connect(socket, &QSslSocket::disconnected, this, fail);
+    connect(socket, &QSslSocket::errorOccurred, this, fail);
+    connect(socket, qOverload<const QList<QSslError> &>(&QSslSocket::sslErrors), this, fail);
+
+    timeout->start(handshakeTimeout);
+    socket->startServerEncryption();
+}
+
+TlsListener::TlsListener(const QSslConfiguration &configuration, int workerCount, QObject *parent)
+    : QTcpServer(parent)
+    , perSecond(rateWindow, 0)
+{
+    clock.start();
+
+    for (int i = 0; i < qMax(1, workerCount); ++i) {
+        QThread *thread = new QThread(this);
+        HandshakeWorker *worker = new HandshakeWorker(configuration, this->thread());
+        worker->moveToThread(thread);
+        connect(thread, &QThread::finished, worker, &QObject::deleteLater);
+        connect(worker, &HandshakeWorker::finished, this, &TlsListener::onHandshakeFinished);
+        thread->start();
+        threads.append(thread);
+        workers.append(worker);
+    }
+}
+
+TlsListener::~TlsListener()
+{
+    close();
+    for (QThread *thread : qAsConst(threads)) {
+        thread->quit();
+        thread->wait();
+    }
+}
+
+TlsStats TlsListener::stats() const
+{
+    advanceClock();
+
+    TlsStats stats = totals;
+    quint64 recent = 0;
+    for (quint32 count : perSecond) recent += count;
+    stats.perSecond = double(recent) / rateWindow;
+    return stats;
+}
+
+void TlsListener::incomingConnection(qintptr socketDescriptor)
+{
+    // По кругу, без учёта загрузки: рукопожатия примерно одинаковы по цене
+    HandshakeWorker *worker = workers[nextWorker];
+    nextWorker = (nextWorker + 1) % workers.size();
+    ++totals.inProgress;
+    QMetaObject::invokeMethod(worker, [worker, socketDescriptor]() {
+        worker->handshake(socketDescriptor);
+    });
+}
+
+void TlsListener::onHandshakeFinished(QSslSocket *socket, qint64 elapsedNs)
+{
+    --totals.inProgress;
+    if (!socket) {
+        ++totals.failures;
+        return;
+    }
+
+    ++totals.handshakes;
+    totals.totalNs += quint64(elapsedNs);
+    totals.maxNs = qMax(totals.maxNs, quint64(elapsedNs));
+    advanceClock();
+    ++perSecond[int(currentSecond % rateWindow)];
+
+    emit clientReady(socket);
+}
+
+void TlsListener::advanceClock() const
+{
+    qint64 now = clock.elapsed() / 1000;
+    if (now - currentSecond >= rateWindow) {
+        perSecond.fill(0);
+    } else {
+        for (qint64 second = currentSecond + 1; second <= now; ++second) {
+            perSecond[int(second % rateWindow)] = 0;
+        }
+    }
+    currentSecond = now;
+}
@@ -0,0 +1,80 @@
+#ifndef TLSLISTENER_H
+#define TLSLISTENER_H
+
+#include <QTcpServer>
+#include <QSslSocket>
+#include <QSslConfiguration>
+#include <QThread>
+#include <QVector>
+#include <QElapsedTimer>
+
+struct TlsStats
+{
+    quint64 handshakes = 0;
+    quint64 failures = 0;
+    quint64 totalNs = 0;
+    quint64 maxNs = 0;
+    int inProgress = 0;
+    double perSecond = 0; // Среднее за последние rateWindow секунд
+};
+
+// Рукопожатие одного соединения, живёт в своём рабочем потоке
+class HandshakeWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    HandshakeWorker(const QSslConfiguration &configuration, QThread *targetThread);
+
+    void handshake(qintptr socketDescriptor);
+
+signals:
+    // socket == nullptr, если рукопожатие не удалось; иначе сокет уже в targetThread
+    void finished(QSslSocket *socket, qint64 elapsedNs);
+
+private:
+    static constexpr int handshakeTimeout = 10000; // мс
+
+    QSslConfiguration configuration;
+    QThread *targetThread;
+};
+
+// Слушающий TLS-сокет. Соединения принимаются в потоке сервера, а
+// рукопожатия (основная цена TLS) идут в пуле рабочих потоков, так что
+// волна переподключений не останавливает доставку сообщений. Готовый
+// зашифрованный сокет переносится обратно и отдаётся через clientReady.
+class TlsListener : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    TlsListener(const QSslConfiguration &configuration, int workerCount, QObject *parent = nullptr);
+    ~TlsListener();
+
+    TlsStats stats() const;
+
+signals:
+    void clientReady(QSslSocket *socket);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private slots:
+    void onHandshakeFinished(QSslSocket *socket, qint64 elapsedNs);
+
+private:
+    static constexpr int rateWindow = 10; // с
+
+    QVector<QThread*> threads;
+    QVector<HandshakeWorker*> workers;
+    int nextWorker = 0;
+
+    TlsStats totals;
+    QElapsedTimer clock;
+    mutable QVector<quint32> perSecond; // Кольцо счётчиков рукопожатий по секундам
+    mutable qint64 currentSecond = 0;
+
+    void advanceClock() const;
+};
+
+#endif // TLSLISTENER_H
@@ -0,0 +1,47 @@
+#ifndef TRACEFORMAT_H
+#define TRACEFORMAT_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+// Формат файла захвата трафика, общий для server и replay.
+//
+// Заголовок: "SCTR" и байт версии. Далее записи подряд:
+//   тип (1 байт), id соединения (varint), время с прошлой записи в нс (varint),
+//   для Frame ещё длина (varint) и сами байты строки без '\n'.
+// Хвост файла может быть оборван, читатель должен это терпеть.
+namespace TraceFormat {
+
+const char magic[4] = { 'S', 'C', 'T', 'R' };
+const quint8 version = 1;
+
+enum RecordType : quint8 {
+    Connect = 1,
+    Frame = 2,
+    Disconnect = 3
+};
+
+inline void appendVarint(QByteArray &out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+// Возвращает false, если данные закончились раньше конца числа
+inline bool readVarint(const char *&pos, const char *end, quint64 &value)
+{
+    value = 0;
+    for (int shift = 0; pos < end && shift < 64; shift += 7) {
+        uchar byte = uchar(*pos++);
+        value |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+} // namespace TraceFormat
+
+#endif // TRACEFORMAT_H
@@ -0,0 +1,97 @@
+#include "tracewriter.h"
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+TraceWriter::~TraceWriter()
+{
+    close();
+}
+
+bool TraceWriter::open(const QString &path)
+{
+    close();
+
+    // В захвате есть пароли из LOGIN, поэтому файл доступен только владельцу
+    // с момента создания, а не после chmod
+#ifdef Q_OS_UNIX
+    int fd = ::open(QFile::encodeName(path).constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+    // Уже существующий файл open() не перевыставляет
+    if (::fchmod(fd, 0600) != 0 || !file.open(fd, QIODevice::WriteOnly, QFileDevice::AutoCloseHandle)) {
+        ::close(fd);
+        return false;
+    }
+#else
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+    file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+#endif
+
+    buffer.append(TraceFormat::magic, sizeof(TraceFormat::magic));
+    buffer.append(char(TraceFormat::version));
+    clock.start();
+    lastRecord = 0;
+    lastFlush = 0;
+    return true;
+}
+
+void TraceWriter::close()
+{
+    if (!file.isOpen()) return;
+
+    file.write(buffer);
+    buffer.clear();
+    file.close();
+}
+
+bool TraceWriter::isOpen() const
+{
+    return file.isOpen();
+}
+
+void TraceWriter::connected(quint32 connectionId)
+{
+    if (!isOpen()) return;
+    beginRecord(TraceFormat::Connect, connectionId);
+    flushIfNeeded();
+}
+
+void TraceWriter::frame(quint32 connectionId, const QByteArray &data)
+{
+    if (!isOpen()) return;
+    beginRecord(TraceFormat::Frame, connectionId);
+    TraceFormat::appendVarint(buffer, quint64(data.size()));
+    buffer.append(data);
+    flushIfNeeded();
+}
+
+void TraceWriter::disconnected(quint32 connectionId)
+{
+    if (!isOpen()) return;
+    beginRecord(TraceFormat::Disconnect, connectionId);
+    flushIfNeeded();
+}
+
+void TraceWriter::beginRecord(TraceFormat::RecordType type, quint32 connectionId)
+{
+    qint64 now = clock.nsecsElapsed();
+    buffer.append(char(type));
+    TraceFormat::appendVarint(buffer, connectionId);
+    TraceFormat::appendVarint(buffer, quint64(now - lastRecord));
+    lastRecord = now;
+}
+
+void TraceWriter::flushIfNeeded()
+{
+    qint64 now = clock.elapsed();
+    if (buffer.size() < 64 * 1024 && now - lastFlush < 1000) return;
+
+    file.write(buffer);
+    file.flush();
+    buffer.clear();
+    lastFlush = now;
+}
@@ -0,0 +1,34 @@
+#ifndef TRACEWRITER_H
+#define TRACEWRITER_H
+
+#include <QFile>
+#include <QElapsedTimer>
+#include "traceformat.h"
+
+// Запись входящих кадров в файл захвата (см. traceformat.h).
+// Пишет через буфер в памяти, на диск сбрасывает раз в секунду или по 64 КБ.
+class TraceWriter
+{
+public:
+    ~TraceWriter();
+
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const;
+
+    void connected(quint32 connectionId);
+    void frame(quint32 connectionId, const QByteArray &data);
+    void disconnected(quint32 connectionId);
+
+private:
+    QFile file;
+    QByteArray buffer;
+    QElapsedTimer clock;
+    qint64 lastRecord = 0; // нс
+    qint64 lastFlush = 0; // мс
+
+    void beginRecord(TraceFormat::RecordType type, quint32 connectionId);
+    void flushIfNeeded();
+};
+
+#endif // TRACEWRITER_H
@@ -1,8 +1,20 @@
 TEMPLATE = subdirs
-SUBDIRS += client server
+SUBDIRS += client server replay bench soak tests
 
 client.file = $$PWD/client/client.pro
 client.target = client
 
 server.file = $$PWD/server/server.pro
 server.target = server
+
+replay.file = $$PWD/replay/replay.pro
+replay.target = replay
+
+bench.file = $$PWD/bench/bench.pro
+bench.target = bench
+
+soak.file = $$PWD/soak/soak.pro
+soak.target = soak
+
+tests.file = $$PWD/tests/tests.pro
+tests.target = tests
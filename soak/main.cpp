@@ -0,0 +1,89 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <QTimer>
+#include "soakrunner.h"
+
+// Итог прогона; код возврата 0 — утечек не найдено, 1 — найдены, 2 — прогон сорвался
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Churns connections against a local server for hours and fails on resource growth.");
+    parser.addHelpOption();
+    QCommandLineOption serverOption("server", "Server binary to start in a temporary directory.", "path",
+                                    QCoreApplication::applicationDirPath() + "/server");
+    QCommandLineOption attachOption("attach", "Watch an already running server with this pid instead of starting one.", "pid");
+    QCommandLineOption logOption("server-log", "Write the output of the started server to a file.", "file");
+    QCommandLineOption hostOption("host", "Server address (STATS needs a loopback address).", "host", "127.0.0.1");
+    QCommandLineOption portOption("port", "Server port.", "port", "1234");
+    QCommandLineOption clientsOption("clients", "Concurrent virtual clients.", "n", "50");
+    QCommandLineOption durationOption("duration", "Run time in seconds.", "s", "7200");
+    QCommandLineOption warmupOption("warmup", "Seconds excluded from the growth check.", "s", "900");
+    QCommandLineOption intervalOption("interval", "Sampling interval in seconds.", "s", "30");
+    QCommandLineOption jsonOption("json", "Write the report as JSON to a file.", "file");
+    parser.addOptions({ serverOption, attachOption, logOption, hostOption, portOption, clientsOption,
+                        durationOption, warmupOption, intervalOption, jsonOption });
+    parser.process(a);
+
+    SoakRunner::Options options;
+    if (parser.isSet(attachOption)) {
+        options.serverPid = parser.value(attachOption).toLongLong();
+    } else {
+        options.serverPath = parser.value(serverOption);
+        options.serverLog = parser.value(logOption);
+    }
+    options.host = parser.value(hostOption);
+    options.port = quint16(parser.value(portOption).toUInt());
+    options.clients = parser.value(clientsOption).toInt();
+    options.duration = parser.value(durationOption).toInt();
+    options.warmup = parser.value(warmupOption).toInt();
+    options.sampleInterval = parser.value(intervalOption).toInt();
+    if (options.clients < 1 || options.duration < 1 || options.sampleInterval < 1 || options.warmup < 0) {
+        qCritical() << "--clients, --duration and --interval must be positive";
+        return 2;
+    }
+
+    SoakRunner runner(options);
+    int exitCode = 0;
+    QObject::connect(&runner, &SoakRunner::finished, &a, [&]() {
+        QJsonObject report = runner.report();
+        QTextStream out(stdout);
+        out << "\nCounters:\n";
+        QJsonObject counters = report["counters"].toObject();
+        for (auto it = counters.constBegin(); it != counters.constEnd(); ++it) {
+            out << "  " << it.key().leftJustified(24) << qint64(it.value().toDouble()) << "\n";
+        }
+
+        if (report.contains("error")) {
+            out << "\nSOAK ABORTED: " << report["error"].toString() << "\n";
+            exitCode = 2;
+        } else if (!runner.passed()) {
+            out << "\nSOAK FAILED:\n";
+            for (const QJsonValue &failure : report["failures"].toArray()) {
+                out << "  " << failure.toString() << "\n";
+            }
+            exitCode = 1;
+        } else {
+            out << "\nSOAK PASSED\n";
+        }
+
+        if (parser.isSet(jsonOption)) {
+            QFile file(parser.value(jsonOption));
+            if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                file.write(QJsonDocument(report).toJson());
+            } else {
+                qCritical() << "Cannot write report" << file.fileName();
+            }
+        }
+        a.exit(exitCode);
+    });
+
+    QTimer::singleShot(0, &runner, &SoakRunner::start);
+    return a.exec();
+}
@@ -0,0 +1,19 @@
+QT += core network
+QT -= gui
+
+CONFIG += c++17 console
+
+TEMPLATE = app
+
+TARGET = soak
+
+OBJECTS_DIR = $$PWD/obj
+MOC_DIR = $$PWD/moc
+RCC_DIR = $$PWD/rcc
+
+SOURCES += main.cpp \
+           soakrunner.cpp
+
+HEADERS += soakrunner.h
+
+DESTDIR = $$PWD/../bin
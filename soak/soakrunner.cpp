@@ -0,0 +1,596 @@
+#include "soakrunner.h"
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QRandomGenerator>
+#include <QTextStream>
+#include <algorithm>
+
+namespace {
+const char password[] = "soak-password";
+
+// Заводятся на каждое соединение: после отключения всех клиентов должны
+// вернуться к значениям, снятым до первого клиента
+const char *const perConnectionStats[] = {
+    "connections",
+    "users",
+    "containers.clients",
+    "containers.user_map",
+    "containers.active_sessions",
+    "containers.connection_ids",
+    "containers.read_buffers",
+    "containers.read_buffer_bytes",
+    "containers.last_activity",
+    "containers.awaiting_pong",
+    "containers.heartbeat_timers",
+    "containers.data_tokens",
+    "containers.client_ids",
+    "containers.traced_writes",
+    "containers.child_objects",
+    "containers.data_channel_tokens",
+    "containers.data_channel_transfers",
+    "containers.pipeline_conversations",
+    "pipeline.pending",
+};
+
+const char *const words[] = {
+    "hello", "lorem", "ipsum", "dolor", "soak", "test", "message", "leak",
+    "socket", "server", "memory", "queue", "timer", "buffer", "session", "latency",
+};
+
+int randomInt(int bound)
+{
+    return int(QRandomGenerator::global()->bounded(bound));
+}
+
+qint64 median(QVector<qint64> values)
+{
+    if (values.isEmpty()) return 0;
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+}
+
+SoakRunner::SoakRunner(const Options &options, QObject *parent)
+    : QObject(parent)
+    , options(options)
+    , clients(options.clients)
+    , users(options.clients)
+{
+    for (VirtualClient &client : clients) {
+        client.clientId = QString::number(QRandomGenerator::system()->generate64(), 16);
+    }
+    sampleTimer.setInterval(options.sampleInterval * 1000);
+    connect(&sampleTimer, &QTimer::timeout, this, &SoakRunner::requestSample);
+    durationTimer.setSingleShot(true);
+    connect(&durationTimer, &QTimer::timeout, this, &SoakRunner::stopChurn);
+    drainTimer.setInterval(1000);
+    connect(&drainTimer, &QTimer::timeout, this, &SoakRunner::requestSample);
+
+    connect(&monitor, &QTcpSocket::connected, this, [this]() {
+        monitorConnected = true;
+        requestSample(); // Первый ответ — базовая линия
+    });
+    connect(&monitor, &QTcpSocket::readyRead, this, &SoakRunner::onMonitorReadyRead);
+    connect(&monitor, &QTcpSocket::errorOccurred, this, [this]() {
+        if (phase == Phase::Done) return;
+        if (!monitorConnected && connectAttempts < connectRetries) {
+            QTimer::singleShot(200, this, &SoakRunner::connectMonitor); // Сервер ещё запускается
+            return;
+        }
+        fail("Lost the monitoring connection: " + monitor.errorString());
+    });
+}
+
+void SoakRunner::start()
+{
+    clock.start();
+
+    if (options.serverPath.isEmpty()) {
+        pid = options.serverPid;
+        connectMonitor();
+        return;
+    }
+
+    // Свой каталог: users.txt, messages и state не смешиваются с настоящими
+    workDir.reset(new QTemporaryDir);
+    if (!workDir->isValid()) {
+        fail("Cannot create a working directory: " + workDir->errorString());
+        return;
+    }
+    server.setWorkingDirectory(workDir->path());
+    if (options.serverLog.isEmpty()) {
+        server.setStandardOutputFile(QProcess::nullDevice());
+        server.setStandardErrorFile(QProcess::nullDevice());
+    } else {
+        server.setProcessChannelMode(QProcess::MergedChannels);
+        server.setStandardOutputFile(options.serverLog);
+    }
+    connect(&server, qOverload<int, QProcess::ExitStatus>(&QProcess::finished), this,
+            [this](int exitCode, QProcess::ExitStatus status) {
+        if (phase == Phase::Done) return;
+        fail(status == QProcess::CrashExit ? QString("Server crashed")
+                                           : QString("Server exited with code %1").arg(exitCode));
+    });
+
+    server.start(options.serverPath, QStringList());
+    if (!server.waitForStarted()) {
+        fail("Cannot start " + options.serverPath + ": " + server.errorString());
+        return;
+    }
+    pid = server.processId();
+    connectMonitor();
+}
+
+void SoakRunner::connectMonitor()
+{
+    if (phase == Phase::Done) return;
+    ++connectAttempts;
+    monitor.connectToHost(options.host, options.port);
+}
+
+void SoakRunner::requestSample()
+{
+    if (awaitingStats || !monitorConnected) return; // Предыдущий ответ ещё не пришёл
+    awaitingStats = true;
+    currentStats.clear();
+    monitor.write("STATS\n");
+}
+
+void SoakRunner::onMonitorReadyRead()
+{
+    monitorBuffer.append(monitor.readAll());
+    int start = 0, newline;
+    while ((newline = monitorBuffer.indexOf('\n', start)) != -1) {
+        QByteArray line = monitorBuffer.mid(start, newline - start).trimmed();
+        start = newline + 1;
+
+        if (line.startsWith("STAT ")) {
+            QList<QByteArray> parts = line.split(' ');
+            if (parts.size() == 3) currentStats.insert(QString::fromLatin1(parts[1]), parts[2].toLongLong());
+        } else if (line == "STATS END") {
+            awaitingStats = false;
+            onStatsReceived();
+        } else if (line == "PING") {
+            monitor.write("PONG\n");
+        } else if (line.startsWith("ERROR")) {
+            fail("Server refused STATS: " + QString::fromUtf8(line));
+        }
+        if (phase == Phase::Done) return;
+    }
+    monitorBuffer.remove(0, start);
+}
+
+void SoakRunner::onStatsReceived()
+{
+    SoakSample sample = takeSample();
+
+    switch (phase) {
+    case Phase::Starting:
+        baseline = sample;
+        beginChurn();
+        break;
+    case Phase::Churning: {
+        samples.append(sample);
+        qint64 seconds = (sample.elapsedMs - churnStart) / 1000;
+        QTextStream(stdout) << QString("[%1:%2:%3] rss anon %4 kB, file %5 kB, fds %6, connections %7, messages %8, resume tickets %9\n")
+                               .arg(seconds / 3600, 2, 10, QChar('0'))
+                               .arg(seconds / 60 % 60, 2, 10, QChar('0'))
+                               .arg(seconds % 60, 2, 10, QChar('0'))
+                               .arg(sample.values.value("rss_anon_kb", -1))
+                               .arg(sample.values.value("rss_file_kb", -1))
+                               .arg(sample.values.value("fds", -1))
+                               .arg(sample.values.value("connections"))
+                               .arg(sample.values.value("messages.stored"))
+                               .arg(sample.values.value("containers.resume_tickets"));
+        break;
+    }
+    case Phase::Draining: {
+        bool settled = true;
+        for (const char *key : perConnectionStats) {
+            if (sample.values.value(key) != baseline.values.value(key)) settled = false;
+        }
+        if (settled || clock.elapsed() > drainDeadline) {
+            finalSample = sample;
+            finishDrain();
+        }
+        break;
+    }
+    case Phase::Done:
+        break;
+    }
+}
+
+SoakSample SoakRunner::takeSample() const
+{
+    SoakSample sample;
+    sample.elapsedMs = clock.elapsed();
+    sample.values = currentStats;
+    if (pid <= 0) return sample;
+
+    // Только Linux: без /proc остаются одни счётчики сервера
+    QFile status(QString("/proc/%1/status").arg(pid));
+    if (status.open(QIODevice::ReadOnly)) {
+        while (!status.atEnd()) {
+            QStringList fields = QString::fromLatin1(status.readLine()).simplified().split(' ');
+            if (fields.size() < 2) continue;
+            // Утечки видны в анонимной памяти. Файловые страницы — отображённые сегменты
+            // индекса и снимок учётных записей — растут с числом сообщений и поиском по ним
+            if (fields[0] == "VmRSS:") sample.values.insert("rss_kb", fields[1].toLongLong());
+            if (fields[0] == "RssAnon:") sample.values.insert("rss_anon_kb", fields[1].toLongLong());
+            if (fields[0] == "RssFile:") sample.values.insert("rss_file_kb", fields[1].toLongLong());
+            if (fields[0] == "Threads:") sample.values.insert("threads", fields[1].toLongLong());
+        }
+    }
+    QDir descriptors(QString("/proc/%1/fd").arg(pid));
+    if (descriptors.exists()) {
+        // Ссылки на сокеты никуда не ведут, без QDir::System они не видны
+        sample.values.insert("fds", descriptors.entryList(QDir::AllEntries | QDir::System | QDir::Hidden | QDir::NoDotAndDotDot).size());
+    }
+
+    return sample;
+}
+
+void SoakRunner::beginChurn()
+{
+    phase = Phase::Churning;
+    churnStart = clock.elapsed();
+    QTextStream(stdout) << QString("Baseline: rss anon %1 kB, fds %2, %3 clients for %4 s (warm-up %5 s)\n")
+                           .arg(baseline.values.value("rss_anon_kb", -1))
+                           .arg(baseline.values.value("fds", -1))
+                           .arg(options.clients)
+                           .arg(options.duration)
+                           .arg(options.warmup);
+
+    // Вразброс в первую секунду, чтобы не начинать с волны одновременных входов
+    for (int i = 0; i < clients.size(); ++i) {
+        QTimer::singleShot(randomInt(1000), this, [this, i]() { startSession(i); });
+    }
+    sampleTimer.start();
+    durationTimer.start(options.duration * 1000);
+}
+
+void SoakRunner::stopChurn()
+{
+    if (phase != Phase::Churning) return;
+    phase = Phase::Draining;
+    sampleTimer.stop();
+
+    for (VirtualClient &client : clients) {
+        if (client.socket) client.socket->abort(); // onSessionEnded не перезапустит: фаза уже другая
+    }
+    drainDeadline = clock.elapsed() + drainTimeout * 1000;
+    drainTimer.start();
+}
+
+void SoakRunner::finishDrain()
+{
+    phase = Phase::Done;
+    drainTimer.stop();
+    monitor.abort();
+    analyze();
+
+    if (server.state() != QProcess::NotRunning) {
+        server.terminate();
+        if (!server.waitForFinished(5000)) server.kill();
+    }
+    emit finished();
+}
+
+void SoakRunner::fail(const QString &message)
+{
+    if (phase == Phase::Done) return;
+    phase = Phase::Done;
+    error = message;
+
+    sampleTimer.stop();
+    durationTimer.stop();
+    drainTimer.stop();
+    for (VirtualClient &client : clients) {
+        if (client.socket) client.socket->abort();
+    }
+    monitor.abort();
+    if (server.state() != QProcess::NotRunning) {
+        server.kill();
+        server.waitForFinished(5000);
+    }
+
+    // Сигнал после возврата: fail() вызывается и из обработчиков сокетов
+    QTimer::singleShot(0, this, &SoakRunner::finished);
+}
+
+void SoakRunner::startSession(int index)
+{
+    if (phase != Phase::Churning) return;
+
+    VirtualClient &client = clients[index];
+    QTcpSocket *socket = new QTcpSocket(this);
+    client.socket = socket;
+    client.readBuffer.clear();
+    client.loggedIn = false;
+    client.stalled = false;
+    client.user = randomInt(20) == 0 ? randomInt(users.size()) : index;
+
+    connect(socket, &QTcpSocket::connected, this, [this, index]() { onSessionConnected(index); });
+    connect(socket, &QTcpSocket::readyRead, this, [this, index]() { onSessionReadyRead(index); });
+    // Сюда приходят все концы сессии: отказ в подключении, abort, закрытие сервером
+    connect(socket, &QTcpSocket::stateChanged, this, [this, index, socket](QAbstractSocket::SocketState state) {
+        if (state == QAbstractSocket::UnconnectedState) onSessionEnded(index, socket);
+    });
+    ++counters["connects"];
+    socket->connectToHost(options.host, options.port);
+}
+
+void SoakRunner::onSessionConnected(int index)
+{
+    VirtualClient &client = clients[index];
+
+    // Иногда рвём связь сразу, ничего не отправив
+    if (randomInt(20) == 0) {
+        ++counters["aborts_before_login"];
+        client.socket->abort();
+        return;
+    }
+
+    User &user = users[client.user];
+    QString name = QString("soak%1").arg(client.user);
+    QByteArray login = ("CLIENT " + client.clientId + "\n").toUtf8();
+    if (!user.registered) login += QString("REGISTER %1 %2\n").arg(name, password).toUtf8();
+    if (!user.resumeToken.isEmpty() && randomInt(2) == 0) {
+        login += ("RESUME " + user.resumeToken + "\n").toUtf8();
+        user.resumeToken.clear(); // Токен одноразовый
+        ++counters["resume_attempts"];
+    } else {
+        login += QString("LOGIN %1 %2\n").arg(name, password).toUtf8();
+        ++counters["password_logins"];
+    }
+    client.actionsLeft = 5 + randomInt(36);
+    client.socket->write(login);
+}
+
+void SoakRunner::onSessionReadyRead(int index)
+{
+    VirtualClient &client = clients[index];
+    User &user = users[client.user];
+
+    client.readBuffer.append(client.socket->readAll());
+    int start = 0, newline;
+    while ((newline = client.readBuffer.indexOf('\n', start)) != -1) {
+        QByteArray line = client.readBuffer.mid(start, newline - start).trimmed();
+        start = newline + 1;
+        ++counters["lines_received"];
+
+        if (line == "PING") {
+            if (!client.stalled) client.socket->write("PONG\n");
+        } else if (line == "OK Registered successfully" || line == "ERROR User already exists") {
+            user.registered = true;
+        } else if (line.startsWith("OK Logged in successfully")) {
+            client.loggedIn = true;
+            ++counters["logins"];
+            scheduleAction(index);
+        } else if (line.startsWith("SESSION ")) {
+            user.resumeToken = QString::fromLatin1(line.mid(8));
+        } else if (line == "ERROR Invalid session") {
+            // Токен забрала другая сессия того же пользователя или он истёк
+            ++counters["resume_rejected"];
+            client.socket->write(QString("LOGIN soak%1 %2\n").arg(client.user).arg(password).toUtf8());
+        } else if (line == "ERROR Session taken over") {
+            ++counters["taken_over"];
+        } else if (line.startsWith("ACK ")) {
+            // id 0: сообщение не сохранено, история на сервере выключена
+            ++counters[line.endsWith(" 0") ? "acks_without_id" : "acks"];
+        } else if (line.startsWith("DUP ")) {
+            ++counters["dups"];
+        } else if (line.startsWith("REJECTED ")) {
+            ++counters["sends_rejected"];
+        } else if (line.startsWith("RETRY ")) {
+            ++counters["retries"]; // Виртуальный клиент не повторяет: сообщения не обязаны дойти
+        } else if (line.startsWith("ERROR Message rejected")) {
+            ++counters["messages_rejected"];
+        } else if (line.startsWith("ERROR")) {
+            ++counters["errors"];
+        }
+    }
+    client.readBuffer.remove(0, start);
+}
+
+void SoakRunner::onSessionEnded(int index, QTcpSocket *socket)
+{
+    VirtualClient &client = clients[index];
+    if (client.socket != socket) return;
+
+    client.socket = nullptr;
+    socket->disconnect(this);
+    socket->deleteLater();
+
+    if (phase == Phase::Churning) {
+        QTimer::singleShot(10 + randomInt(500), this, [this, index]() { startSession(index); });
+    }
+}
+
+void SoakRunner::scheduleAction(int index)
+{
+    QTcpSocket *socket = clients[index].socket;
+    // Таймер привязан к сокету: удалённый вместе с сессией, он не сработает
+    QTimer::singleShot(100 + randomInt(300), socket, [this, index, socket]() {
+        if (clients[index].socket == socket && socket->state() == QAbstractSocket::ConnectedState) act(index);
+    });
+}
+
+void SoakRunner::act(int index)
+{
+    VirtualClient &client = clients[index];
+    if (--client.actionsLeft <= 0) {
+        endSession(index);
+        return;
+    }
+
+    QString peer = QString("soak%1").arg(randomInt(users.size()));
+    int dice = randomInt(100);
+    QString command;
+    if (dice < 50) {
+        command = QString("SEND %1 %2 %3").arg(client.nextSequence++).arg(peer, randomText());
+        ++counters["messages"];
+    } else if (dice < 70) {
+        command = QString("MSG %1 %2").arg(peer, randomText());
+        ++counters["messages"];
+    } else if (dice < 78) {
+        command = "MSG ALL " + randomText();
+        ++counters["messages"];
+    } else if (dice < 86) {
+        command = "LIST";
+    } else if (dice < 91) {
+        command = QString("HISTORY @%1 0 50").arg(peer);
+    } else if (dice < 96) {
+        command = QString("SEARCH ") + words[randomInt(int(sizeof(words) / sizeof(words[0])))];
+    } else {
+        command = "DATA";
+    }
+    client.socket->write((command + "\n").toUtf8());
+    scheduleAction(index);
+}
+
+void SoakRunner::endSession(int index)
+{
+    VirtualClient &client = clients[index];
+    QTcpSocket *socket = client.socket;
+    int dice = randomInt(100);
+    if (dice < 40) {
+        ++counters["graceful_disconnects"];
+        socket->disconnectFromHost();
+    } else if (dice < 75) {
+        ++counters["aborts"];
+        socket->abort();
+    } else if (dice < 90) {
+        // Оборванная строка остаётся в буфере сервера до отключения
+        ++counters["partial_frame_aborts"];
+        socket->write("MSG soak0 unterminated");
+        QTimer::singleShot(100, socket, [socket]() { socket->abort(); });
+    } else {
+        // Молчим: сервер пришлёт PING и закроет соединение по таймауту
+        ++counters["stalls"];
+        client.stalled = true;
+    }
+}
+
+QString SoakRunner::randomText() const
+{
+    QStringList text;
+    int count = 1 + randomInt(8);
+    for (int i = 0; i < count; ++i) {
+        text.append(words[randomInt(int(sizeof(words) / sizeof(words[0])))]);
+    }
+    return text.join(' ');
+}
+
+void SoakRunner::analyze()
+{
+    // Сразу после отключения всех клиентов: всё, что заводилось на соединение, должно уйти
+    for (const char *key : perConnectionStats) {
+        qint64 before = baseline.values.value(key);
+        qint64 after = finalSample.values.value(key);
+        if (after != before) {
+            failures.append(QString("%1 is %2 after all clients left, was %3 before").arg(key).arg(after).arg(before));
+        }
+    }
+
+    // Номера SEND у каждого виртуального клиента свои и только растут, DUP значит, что сервер спутал клиентов
+    if (counters.value("dups") > 0) {
+        failures.append(QString("%1 SENDs were answered DUP").arg(counters.value("dups")));
+    }
+    if (finalSample.values.value("fds") > baseline.values.value("fds") + 4) {
+        failures.append(QString("%1 descriptors open after all clients left, %2 before")
+                        .arg(finalSample.values.value("fds")).arg(baseline.values.value("fds")));
+    }
+
+    QVector<SoakSample> steady;
+    for (const SoakSample &sample : qAsConst(samples)) {
+        if (sample.elapsedMs - churnStart >= qint64(options.warmup) * 1000) steady.append(sample);
+    }
+    if (steady.size() < minTrendSamples) {
+        QTextStream(stdout) << QString("Only %1 samples after warm-up, growth trends are not checked\n").arg(steady.size());
+        return;
+    }
+
+    // Устойчивый рост: медианы четвертей не убывают и последняя больше первой сверх допуска.
+    // Медианы сглаживают пилу от волн подключений и периодических чисток.
+    QStringList keys = { "rss_anon_kb", "fds", "threads" };
+    for (const QString &key : steady.last().values.keys()) {
+        if (key.startsWith("containers.")) keys.append(key);
+    }
+    for (const QString &key : qAsConst(keys)) {
+        if (!steady.last().values.contains(key)) continue;
+
+        QVector<qint64> medians;
+        for (int quarter = 0; quarter < 4; ++quarter) {
+            QVector<qint64> values;
+            for (int i = quarter * steady.size() / 4; i < (quarter + 1) * steady.size() / 4; ++i) {
+                values.append(steady[i].values.value(key));
+            }
+            medians.append(median(values));
+        }
+
+        double relative = 0.25;
+        qint64 absolute = 32;
+        if (key == "rss_anon_kb") {
+            relative = 0.10;
+            absolute = 8192;
+        } else if (key == "fds") {
+            relative = 0;
+            absolute = 8;
+        } else if (key == "threads") {
+            relative = 0;
+            absolute = 4;
+        }
+        qint64 growth = medians.last() - medians.first();
+        qint64 allowed = qMax(absolute, qint64(medians.first() * relative));
+        bool steadyGrowth = std::is_sorted(medians.begin(), medians.end()) && growth > allowed;
+
+        QJsonObject trend;
+        trend["first_quarter"] = double(medians.first());
+        trend["last_quarter"] = double(medians.last());
+        trend["allowed_growth"] = double(allowed);
+        trend["growing"] = steadyGrowth;
+        trends[key] = trend;
+        if (steadyGrowth) {
+            failures.append(QString("%1 grows steadily: %2 -> %3 (allowed +%4)")
+                            .arg(key).arg(medians.first()).arg(medians.last()).arg(allowed));
+        }
+    }
+}
+
+QJsonObject SoakRunner::report() const
+{
+    auto toJson = [](const QMap<QString, qint64> &values) {
+        QJsonObject object;
+        for (auto it = values.cbegin(); it != values.cend(); ++it) object[it.key()] = double(it.value());
+        return object;
+    };
+
+    QJsonObject counterValues;
+    for (auto it = counters.cbegin(); it != counters.cend(); ++it) counterValues[it.key()] = double(it.value());
+
+    QJsonArray series;
+    for (const SoakSample &sample : samples) {
+        QJsonObject point;
+        point["t_s"] = double(sample.elapsedMs - churnStart) / 1000.0;
+        for (const char *key : { "rss_kb", "rss_anon_kb", "rss_file_kb", "fds", "threads", "connections", "messages.stored" }) {
+            point[key] = double(sample.values.value(key, -1));
+        }
+        series.append(point);
+    }
+
+    QJsonObject result;
+    result["passed"] = passed();
+    if (!error.isEmpty()) result["error"] = error;
+    result["failures"] = QJsonArray::fromStringList(failures);
+    result["clients"] = options.clients;
+    result["duration_s"] = options.duration;
+    result["warmup_s"] = options.warmup;
+    result["counters"] = counterValues;
+    result["baseline"] = toJson(baseline.values);
+    result["final"] = toJson(finalSample.values);
+    result["trends"] = trends;
+    result["series"] = series;
+    return result;
+}
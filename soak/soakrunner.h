@@ -0,0 +1,136 @@
+#ifndef SOAKRUNNER_H
+#define SOAKRUNNER_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QMap>
+#include <QVector>
+#include <memory>
+
+struct SoakSample
+{
+    qint64 elapsedMs = 0;
+    QMap<QString, qint64> values; // rss_kb, rss_anon_kb, rss_file_kb, fds, threads и все строки STATS
+};
+
+// Долгий прогон против локального сервера: виртуальные клиенты по кругу
+// подключаются, входят (паролем или RESUME), пишут сообщения и команды и
+// обрывают связь разными способами — штатно, abort, посреди строки или
+// молча, дожидаясь таймаута сервера. Раз в sampleInterval снимаются RSS,
+// число дескрипторов и потоков процесса (/proc) и размеры контейнеров
+// сервера (STATS). Прогон не проходит, если метрика растёт устойчиво —
+// медиана каждой четверти после разогрева не меньше предыдущей, а рост
+// больше допуска, — или если после отключения всех клиентов контейнеры
+// не вернулись к исходным размерам.
+class SoakRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options
+    {
+        QString serverPath; // Запустить сервер во временном каталоге; пусто — следить за serverPid
+        QString serverLog; // Куда писать вывод запущенного сервера, по умолчанию никуда
+        qint64 serverPid = 0;
+        QString host = "127.0.0.1";
+        quint16 port = 1234;
+        int clients = 50;
+        int duration = 7200; // с
+        int warmup = 900; // с, дольше жизни токенов RESUME: к этому времени их число выходит на плато
+        int sampleInterval = 30; // с
+    };
+
+    explicit SoakRunner(const Options &options, QObject *parent = nullptr);
+
+    void start();
+    QJsonObject report() const;
+    bool passed() const { return failures.isEmpty() && error.isEmpty(); }
+
+signals:
+    void finished();
+
+private slots:
+    void requestSample();
+    void stopChurn();
+
+private:
+    struct VirtualClient
+    {
+        QTcpSocket *socket = nullptr;
+        int user = 0; // Чаще всего свой номер; чужой проверяет вытеснение сессии
+        int actionsLeft = 0;
+        bool loggedIn = false;
+        bool stalled = false; // Молчит и не отвечает на PING
+        QString clientId; // CLIENT: свой на каждый прогон, иначе сервер с --attach сочтёт номера SEND повтором
+        quint64 nextSequence = 1; // Номера растут у пары (пользователь, id клиента)
+        QByteArray readBuffer;
+    };
+
+    struct User
+    {
+        bool registered = false;
+        QString resumeToken;
+    };
+
+    enum class Phase { Starting, Churning, Draining, Done };
+
+    static constexpr int connectRetries = 50; // По 200 мс, пока сервер запускается
+    static constexpr int drainTimeout = 60; // с: молчащие сессии сервер закрывает через 40 с
+    static constexpr int minTrendSamples = 8;
+
+    Options options;
+    Phase phase = Phase::Starting;
+    std::unique_ptr<QTemporaryDir> workDir;
+    QProcess server;
+    qint64 pid = 0;
+
+    QTcpSocket monitor; // Соединение для STATS, само входит в базовую линию
+    QByteArray monitorBuffer;
+    bool monitorConnected = false;
+    bool awaitingStats = false;
+    int connectAttempts = 0;
+    QMap<QString, qint64> currentStats;
+
+    QVector<VirtualClient> clients;
+    QVector<User> users;
+    QElapsedTimer clock;
+    QTimer sampleTimer;
+    QTimer durationTimer;
+    QTimer drainTimer;
+    qint64 churnStart = 0; // мс по clock
+    qint64 drainDeadline = 0;
+
+    SoakSample baseline; // До первого клиента
+    QVector<SoakSample> samples;
+    SoakSample finalSample; // После отключения всех клиентов
+    QMap<QString, quint64> counters;
+    QJsonObject trends;
+    QStringList failures;
+    QString error;
+
+    void connectMonitor();
+    void onMonitorReadyRead();
+    void onStatsReceived();
+    SoakSample takeSample() const;
+    void beginChurn();
+    void finishDrain();
+    void fail(const QString &message); // Прогон прерывается: сервер упал или недоступен
+
+    void startSession(int index);
+    void onSessionConnected(int index);
+    void onSessionReadyRead(int index);
+    void onSessionEnded(int index, QTcpSocket *socket);
+    void scheduleAction(int index);
+    void act(int index);
+    void endSession(int index);
+    QString randomText() const;
+
+    void analyze();
+};
+
+#endif // SOAKRUNNER_H
@@ -0,0 +1,18 @@
+QT += core testlib
+QT -= gui
+
+CONFIG += c++17 console testcase
+
+TEMPLATE = app
+
+TARGET = tst_outbox
+
+OBJECTS_DIR = $$PWD/obj
+MOC_DIR = $$PWD/moc
+
+INCLUDEPATH += $$PWD/../../client
+
+SOURCES += tst_outbox.cpp \
+           ../../client/outbox.cpp
+
+HEADERS += ../../client/outbox.h
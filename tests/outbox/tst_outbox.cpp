@@ -0,0 +1,117 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include "outbox.h"
+
+// Как сервер для одного id клиента: номер помечается при получении,
+// всё не больше последнего отбрасывается как DUP
+class SequenceMark
+{
+public:
+    bool accept(quint64 sequence)
+    {
+        if (sequence <= last) return false;
+        last = sequence;
+        return true;
+    }
+
+private:
+    quint64 last = 0;
+};
+
+class OutboxTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void newSendWaitsBehindRetry();
+    void answeredDeferredIsSkipped();
+    void reopenKeepsPendingAndNumbers();
+};
+
+// RETRY, а пока клиент выжидает интервал, пользователь пишет ещё одно
+void OutboxTest::newSendWaitsBehindRetry()
+{
+    QTemporaryDir dir;
+    Outbox outbox;
+    QVERIFY(outbox.open(dir.filePath("outbox.log")));
+    SequenceMark server;
+
+    OutgoingMessage limited = outbox.enqueue("ALL", "one");
+    QVERIFY(server.accept(limited.sequence));
+    OutgoingMessage inFlight = outbox.enqueue("ALL", "two");
+    QVERIFY(!outbox.hasDeferred());
+    QVERIFY(server.accept(inFlight.sequence));
+
+    // Ответ RETRY на первое: номер уже учтён, нужен новый
+    OutgoingMessage retried = outbox.requeue(limited.sequence);
+    QCOMPARE(retried.text, QString("one"));
+    QVERIFY(retried.sequence > inFlight.sequence);
+    QVERIFY(outbox.hasDeferred());
+
+    OutgoingMessage typed = outbox.enqueue("bob", "three");
+    QVERIFY(outbox.hasDeferred()); // Сразу не отправляется
+
+    OutgoingMessage next = outbox.takeDeferred();
+    QCOMPARE(next.sequence, retried.sequence);
+    QVERIFY(server.accept(next.sequence));
+    next = outbox.takeDeferred();
+    QCOMPARE(next.sequence, typed.sequence);
+    QVERIFY(server.accept(next.sequence));
+    QVERIFY(!outbox.hasDeferred());
+    QCOMPARE(outbox.takeDeferred().sequence, quint64(0));
+
+    QVERIFY(outbox.remove(inFlight.sequence));
+    QVERIFY(outbox.remove(retried.sequence));
+    QVERIFY(outbox.remove(typed.sequence));
+    QVERIFY(outbox.pending().isEmpty());
+}
+
+void OutboxTest::answeredDeferredIsSkipped()
+{
+    QTemporaryDir dir;
+    Outbox outbox;
+    QVERIFY(outbox.open(dir.filePath("outbox.log")));
+
+    OutgoingMessage limited = outbox.enqueue("ALL", "one");
+    OutgoingMessage retried = outbox.requeue(limited.sequence);
+    OutgoingMessage typed = outbox.enqueue("ALL", "two");
+
+    // После переподключения очередь ушла целиком, и ответ на повтор уже пришёл
+    QVERIFY(outbox.remove(retried.sequence));
+    QCOMPARE(outbox.takeDeferred().sequence, typed.sequence);
+    QVERIFY(!outbox.hasDeferred());
+
+    QVERIFY(outbox.requeue(typed.sequence).sequence > typed.sequence);
+    outbox.clearDeferred();
+    QVERIFY(!outbox.hasDeferred());
+    QCOMPARE(outbox.requeue(limited.sequence).sequence, quint64(0)); // Уже не в очереди
+}
+
+void OutboxTest::reopenKeepsPendingAndNumbers()
+{
+    QTemporaryDir dir;
+    QString path = dir.filePath("outbox.log");
+    quint64 last = 0;
+    QString id;
+    {
+        Outbox outbox;
+        QVERIFY(outbox.open(path));
+        id = outbox.clientId();
+        OutgoingMessage first = outbox.enqueue("ALL", "one");
+        OutgoingMessage second = outbox.enqueue("bob", "two");
+        last = outbox.requeue(first.sequence).sequence;
+        QVERIFY(last > second.sequence);
+    }
+
+    Outbox outbox;
+    QVERIFY(outbox.open(path));
+    QCOMPARE(outbox.clientId(), id);
+    QCOMPARE(outbox.pending().size(), 2);
+    QCOMPARE(outbox.pending().last().sequence, last);
+    QVERIFY(!outbox.hasDeferred()); // Новая сессия отправит всё по порядку сама
+    QVERIFY(outbox.enqueue("ALL", "three").sequence > last);
+}
+
+QTEST_APPLESS_MAIN(OutboxTest)
+
+#include "tst_outbox.moc"